@@ -6,8 +6,21 @@
 #include <cstdlib>
 #include <ctime>
 #include <cmath>
+#include <climits>
 #include <mpi.h>
 #include <algorithm>
+#include <random>
+
+// AVX2 kernels for the local sort are compiled per function and picked at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BITONIC_SIMD 1
+#else
+#define BITONIC_SIMD 0
+#endif
+
+// Keys per message in the pipelined compare-split
+#define CHUNK_SIZE (1 << 14)
 
 // Globals
 double timer_start;
@@ -15,6 +28,12 @@ double timer_end;
 int process_rank;
 int num_processes;
 int *array;
+int *merge_buffer;  // Output of each compare-split merge, swapped with array afterwards
+int *recv_buffer;   // Partner's run in each compare-split, allocated once for the whole sort
+int *send_head;     // Run length followed by the first chunk, the first message of each compare-split
+int *recv_head;
+MPI_Request *send_requests;  // One request per chunk of a compare-split run
+MPI_Request *recv_requests;
 int array_size;
 
 /* Define Caliper region names */
@@ -29,126 +48,413 @@ const char* correctness_check = "correctness_check";
 
 
 ///////////////////////////////////////////////////
-// Comparison Function
+// Local Sort
 ///////////////////////////////////////////////////
-int ComparisonFunc(const void *a, const void *b) {
-    return (*(int *)a - *(int *)b);
+// The initial local sort uses AVX2 sorting networks when the CPU has them: every 64 keys are
+// sorted as eight columns of eight in registers and transposed into eight sorted rows, then
+// bottom-up passes merge the runs two vectors at a time with a bitonic merge network.
+// Other CPUs and compilers fall back to std::sort
+#if BITONIC_SIMD
+__attribute__((target("avx2")))
+static inline void MinMax(__m256i &a, __m256i &b) {
+    __m256i lo = _mm256_min_epi32(a, b);
+    b = _mm256_max_epi32(a, b);
+    a = lo;
 }
 
-///////////////////////////////////////////////////
-// Compare Low
-///////////////////////////////////////////////////
-void CompareLow(int j) {
-    CALI_MARK_BEGIN(comm);
-    CALI_MARK_BEGIN(comm_large);  // Start communication region for large data exchange
+// Sorts a bitonic vector ascending: half cleaners at distance 4, 2 and 1
+__attribute__((target("avx2")))
+static inline __m256i BitonicClean8(__m256i v) {
+    __m256i p = _mm256_permute2x128_si256(v, v, 0x01);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xF0);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xCC);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xAA);
+    return v;
+}
 
-    int i, min;
+// Two sorted vectors in, the smallest eight keys sorted in a and the largest eight sorted in b
+__attribute__((target("avx2")))
+static inline void BitonicMerge16(__m256i &a, __m256i &b) {
+    b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    MinMax(a, b);
+    a = BitonicClean8(a);
+    b = BitonicClean8(b);
+}
 
-    // Send entire array to paired H Process
-    int send_counter = 0;
-    int *buffer_send = new int[array_size + 1];
-    MPI_Send(&array[array_size - 1], 1, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD);
+// Sorts 64 keys into eight sorted runs of eight
+__attribute__((target("avx2")))
+static void SortNetwork64(int *data) {
+    __m256i r[8];
+    for (int i = 0; i < 8; i++) {
+        r[i] = _mm256_loadu_si256((__m256i *) (data + i * 8));
+    }
 
-    // Receive new min of sorted numbers
-    MPI_Recv(&min, 1, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    // Optimal 19 comparator network for 8 inputs, applied to all eight columns at once
+    MinMax(r[0], r[2]); MinMax(r[1], r[3]); MinMax(r[4], r[6]); MinMax(r[5], r[7]);
+    MinMax(r[0], r[4]); MinMax(r[1], r[5]); MinMax(r[2], r[6]); MinMax(r[3], r[7]);
+    MinMax(r[0], r[1]); MinMax(r[2], r[3]); MinMax(r[4], r[5]); MinMax(r[6], r[7]);
+    MinMax(r[2], r[4]); MinMax(r[3], r[5]);
+    MinMax(r[1], r[4]); MinMax(r[3], r[6]);
+    MinMax(r[1], r[2]); MinMax(r[3], r[4]); MinMax(r[5], r[6]);
+
+    // Transpose so every sorted column becomes a sorted row
+    __m256i t[8], u[8];
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++) {
+        r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
 
-    // Buffers all values which are greater than min sent from H Process
-    for (i = 0; i < array_size; i++) {
-        if (array[i] > min) {
-            buffer_send[send_counter + 1] = array[i];
-            send_counter++;
-        } else {
-            break;
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i *) (data + i * 8), r[i]);
+    }
+}
+
+// Merges sorted a[0, na) and b[0, nb) into out. Eight keys at a time pass through the bitonic
+// merge network while both inputs have a full vector left, the tails finish in scalar code
+__attribute__((target("avx2")))
+static void MergeRuns(const int *a, int na, const int *b, int nb, int *out) {
+    int ia = 0, ib = 0, k = 0;
+
+    if (na >= 8 && nb >= 8) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *) a);
+        __m256i hi = _mm256_loadu_si256((const __m256i *) b);
+        ia = 8;
+        ib = 8;
+
+        while (true) {
+            BitonicMerge16(lo, hi);
+            _mm256_storeu_si256((__m256i *) (out + k), lo);
+            k += 8;
+
+            // Refill from whichever input has the smaller next key, hi keeps the eight largest so far
+            bool takeA = ib >= nb || (ia < na && a[ia] <= b[ib]);
+            if (takeA ? ia + 8 > na : ib + 8 > nb) {
+                break;
+            }
+
+            if (takeA) {
+                lo = _mm256_loadu_si256((const __m256i *) (a + ia));
+                ia += 8;
+            } else {
+                lo = _mm256_loadu_si256((const __m256i *) (b + ib));
+                ib += 8;
+            }
+        }
+
+        // The eight keys still in hi are not below anything already written, merge them with both tails
+        int pending[8];
+        _mm256_storeu_si256((__m256i *) pending, hi);
+        int ip = 0;
+        while (ip < 8) {
+            if (ia < na && a[ia] < pending[ip] && (ib >= nb || a[ia] <= b[ib])) {
+                out[k++] = a[ia++];
+            } else if (ib < nb && b[ib] < pending[ip]) {
+                out[k++] = b[ib++];
+            } else {
+                out[k++] = pending[ip++];
+            }
         }
     }
 
-    buffer_send[0] = send_counter;
+    std::merge(a + ia, a + na, b + ib, b + nb, out + k);
+}
+
+static bool HasAVX2() {
+    static bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+// Sorts data[0, n), scratch must hold n keys
+void LocalSort(int *data, int n, int *scratch) {
+#if BITONIC_SIMD
+    if (HasAVX2() && n >= 64) {
+        int blocks = n / 64 * 64;
+        for (int i = 0; i < blocks; i += 64) {
+            SortNetwork64(data + i);
+        }
+
+        // The tail is one sorted run, so every run boundary below still splits sorted runs
+        std::sort(data + blocks, data + n);
+
+        int *src = data, *dst = scratch;
+        for (int width = 8; width < n; width *= 2) {
+            for (int i = 0; i < n; i += 2 * width) {
+                int mid = std::min(i + width, n);
+                int end = std::min(i + 2 * width, n);
+                MergeRuns(src + i, mid - i, src + mid, end - mid, dst + i);
+            }
+            std::swap(src, dst);
+        }
+
+        if (src != data) {
+            std::copy(src, src + n, data);
+        }
+        return;
+    }
+#endif
 
-    // Send partition to paired H process
-    MPI_Send(buffer_send, send_counter, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD);
+    std::sort(data, data + n);
+}
 
-    // Receive info from paired H process
-    int *buffer_receive = new int[array_size + 1];
-    MPI_Recv(buffer_receive, array_size, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+///////////////////////////////////////////////////
+// Merge Low
+///////////////////////////////////////////////////
+// Linear merge of the sorted local block with the partner's sorted candidates,
+// keeps the array_size smallest keys in merge_buffer. The candidates arrive front
+// first in CHUNK_SIZE pieces, each one is only waited for once the merge reaches it,
+// and the merge stops as soon as the block is full
+void MergeLow(int *received, int recv_counter, MPI_Request *requests) {
+    int a = 0, b = 0;
+    int ready = 0, next_chunk = 0;
+    for (int k = 0; k < array_size; k++) {
+        if (b == ready && ready < recv_counter) {
+            MPI_Wait(&requests[next_chunk++], MPI_STATUS_IGNORE);
+            ready = std::min(recv_counter, next_chunk * CHUNK_SIZE);
+        }
 
-    // Take received buffer of values from H Process which are smaller than current max
-    for (i = 1; i < buffer_receive[0] + 1; i++) {
-        if (array[array_size - 1] < buffer_receive[i]) {
-            array[array_size - 1] = buffer_receive[i];
+        if (b < ready && received[b] < array[a]) {
+            merge_buffer[k] = received[b++];
         } else {
-            break;
+            merge_buffer[k] = array[a++];
         }
     }
+}
+
+///////////////////////////////////////////////////
+// Merge High
+///////////////////////////////////////////////////
+// Same merge from the back, keeps the array_size largest keys. The candidates arrive back first
+void MergeHigh(int *received, int recv_counter, MPI_Request *requests) {
+    int a = array_size - 1, b = recv_counter - 1;
+    int ready = recv_counter, next_chunk = 0;
+    for (int k = array_size - 1; k >= 0; k--) {
+        if (b == ready - 1 && ready > 0) {
+            MPI_Wait(&requests[next_chunk++], MPI_STATUS_IGNORE);
+            ready = std::max(0, recv_counter - next_chunk * CHUNK_SIZE);
+        }
+
+        if (b >= ready && received[b] > array[a]) {
+            merge_buffer[k] = received[b--];
+        } else {
+            merge_buffer[k] = array[a--];
+        }
+    }
+}
+
+///////////////////////////////////////////////////
+// Compare Split
+///////////////////////////////////////////////////
+// Keeps the lower (low) or upper half of our block and the partner's. Boundary keys are swapped
+// with MPI_Sendrecv, so neither side waits for the other to finish sending first. Only keys that
+// can cross move: the L side's tail above the partner's min and the H side's head below the
+// partner's max. Both runs stream in CHUNK_SIZE pieces in the order the receiving merge consumes
+// them, so merging one chunk overlaps the transfer of the next. The run length rides in front of
+// the first chunk instead of costing its own round trip
+void CompareSplit(int partner, bool low) {
+    CALI_MARK_BEGIN(comm);
+    CALI_MARK_BEGIN(comm_large);  // Start communication region for large data exchange
+
+    int boundary = low ? array[array_size - 1] : array[0];
+    int partner_boundary;
+    MPI_Sendrecv(&boundary, 1, MPI_INT, partner, 0,
+                 &partner_boundary, 1, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    int first, send_counter;
+    if (low) {
+        first = std::upper_bound(array, array + array_size, partner_boundary) - array;
+        send_counter = array_size - first;
+    } else {
+        first = 0;
+        send_counter = std::lower_bound(array, array + array_size, partner_boundary) - array;
+    }
+
+    // The L side merges from the front and the H side from the back, so the H side sends its head
+    // front first and the L side sends its tail back first. Chunks keep their place in recv_buffer
+    int send_chunks = (send_counter + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int head_start = low ? std::max(first, array_size - CHUNK_SIZE) : 0;
+    int head_length = std::min(CHUNK_SIZE, send_counter);
+    send_head[0] = send_counter;
+    std::copy(array + head_start, array + head_start + head_length, send_head + 1);
+    MPI_Isend(send_head, head_length + 1, MPI_INT, partner, 1, MPI_COMM_WORLD, &send_requests[0]);
+
+    for (int c = 1; c < send_chunks; c++) {
+        int start = low ? std::max(first, array_size - (c + 1) * CHUNK_SIZE) : c * CHUNK_SIZE;
+        int length = std::min(CHUNK_SIZE, send_counter - c * CHUNK_SIZE);
+        MPI_Isend(array + start, length, MPI_INT, partner, 2, MPI_COMM_WORLD, &send_requests[c]);
+    }
+
+    // The first message tells how many keys follow, the merge needs its chunk first anyway
+    MPI_Recv(recv_head, CHUNK_SIZE + 1, MPI_INT, partner, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    int recv_counter = recv_head[0];
+    int recv_chunks = (recv_counter + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int recv_head_length = std::min(CHUNK_SIZE, recv_counter);
+    std::copy(recv_head + 1, recv_head + 1 + recv_head_length,
+              recv_buffer + (low ? 0 : recv_counter - recv_head_length));
+    recv_requests[0] = MPI_REQUEST_NULL;
+
+    for (int c = 1; c < recv_chunks; c++) {
+        int start = low ? c * CHUNK_SIZE : std::max(0, recv_counter - (c + 1) * CHUNK_SIZE);
+        int length = std::min(CHUNK_SIZE, recv_counter - c * CHUNK_SIZE);
+        MPI_Irecv(recv_buffer + start, length, MPI_INT, partner, 2, MPI_COMM_WORLD, &recv_requests[c]);
+    }
 
     CALI_MARK_END(comm_large);  // End communication region for large data exchange
     CALI_MARK_END(comm);
 
     CALI_MARK_BEGIN(comp_large);  // Start computation region for large data sorting
-    // Sequential Sort
-    std::qsort(array, array_size, sizeof(int), ComparisonFunc);
+    // Local data stays sorted for the next stage
+    if (recv_counter > 0) {
+        if (low) {
+            MergeLow(recv_buffer, recv_counter, recv_requests);
+        } else {
+            MergeHigh(recv_buffer, recv_counter, recv_requests);
+        }
+    }
     CALI_MARK_END(comp_large);  // End computation region for large data sorting
 
-    // Free allocated memory
-    delete[] buffer_send;
-    delete[] buffer_receive;
+    CALI_MARK_BEGIN(comm);
+    CALI_MARK_BEGIN(comm_large);
+
+    // Chunks past the split point were never needed by the merge but must still land, and the
+    // outgoing chunks must leave array before it becomes the next merge buffer
+    MPI_Waitall(recv_chunks, recv_requests, MPI_STATUSES_IGNORE);
+    MPI_Waitall(std::max(send_chunks, 1), send_requests, MPI_STATUSES_IGNORE);
+
+    CALI_MARK_END(comm_large);
+    CALI_MARK_END(comm);
+
+    if (recv_counter > 0) {
+        std::swap(array, merge_buffer);
+    }
 }
 
 ///////////////////////////////////////////////////
-// Compare High
+// Compare Low
 ///////////////////////////////////////////////////
-void CompareHigh(int j) {
-    CALI_MARK_BEGIN(comm);
-    CALI_MARK_BEGIN(comm_large);  // Start communication region for large data exchange
+void CompareLow(int partner) {
+    CompareSplit(partner, true);
+}
 
-    int i, max;
+///////////////////////////////////////////////////
+// Compare High
+///////////////////////////////////////////////////
+void CompareHigh(int partner) {
+    CompareSplit(partner, false);
+}
 
-    // Receive max from L Process's entire array
-    int *buffer_receive = new int[array_size + 1];
-    MPI_Recv(&max, 1, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+///////////////////////////////////////////////////
+// Bitonic Merge
+///////////////////////////////////////////////////
+// Bitonic network for any number of ranks (Lang's arbitrary-n construction) with a
+// compare-split between whole ranks at every comparator. Ranks lo .. lo + n - 1 hold
+// a bitonic sequence of blocks and end up sorted ascending when up is true.
+// Every rank walks the recursion in the same order and only performs its own
+// compare-splits, so each pair of partners meets at the same point and cannot deadlock
+void BitonicMerge(int lo, int n, bool up) {
+    if (n <= 1) {
+        return;
+    }
 
-    // Send min to L Process of current process's array
-    int send_counter = 0;
-    int *buffer_send = new int[array_size + 1];
-    MPI_Send(&array[0], 1, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD);
+    // Greatest power of two less than n
+    int m = 1;
+    while (m * 2 < n) {
+        m *= 2;
+    }
 
-    // Buffer a list of values which are smaller than max value
-    for (i = 0; i < array_size; i++) {
-        if (array[i] < max) {
-            buffer_send[send_counter + 1] = array[i];
-            send_counter++;
+    if (process_rank >= lo && process_rank < lo + n - m) {
+        if (up) {
+            CompareLow(process_rank + m);
+        } else {
+            CompareHigh(process_rank + m);
+        }
+    } else if (process_rank >= lo + m && process_rank < lo + n) {
+        if (up) {
+            CompareHigh(process_rank - m);
         } else {
-            break;
+            CompareLow(process_rank - m);
         }
     }
 
-    // Receive blocks greater than min from paired process
-    MPI_Recv(buffer_receive, array_size, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    int recv_counter = buffer_receive[0];
+    // The two halves are independent, only recurse into ours
+    if (process_rank < lo + m) {
+        BitonicMerge(lo, m, up);
+    } else {
+        BitonicMerge(lo + m, n - m, up);
+    }
+}
 
-    // Send partition to paired process
-    buffer_send[0] = send_counter;
-    MPI_Send(buffer_send, send_counter, MPI_INT, process_rank ^ (1 << j), 0, MPI_COMM_WORLD);
+///////////////////////////////////////////////////
+// Bitonic Sort
+///////////////////////////////////////////////////
+// Sorts the blocks of ranks lo .. lo + n - 1, each block must already be sorted locally
+void BitonicSort(int lo, int n, bool up) {
+    if (n <= 1) {
+        return;
+    }
 
-    // Take received buffer of values from L Process which are greater than current min
-    for (i = 1; i < recv_counter + 1; i++) {
-        if (buffer_receive[i] > array[0]) {
-            array[0] = buffer_receive[i];
-        } else {
-            break;
-        }
+    // Sort the halves in opposite directions to form a bitonic sequence, then merge it
+    int m = n / 2;
+    if (process_rank < lo + m) {
+        BitonicSort(lo, m, !up);
+    } else {
+        BitonicSort(lo + m, n - m, up);
     }
 
-    CALI_MARK_END(comm_large);  // End communication region for large data exchange
-    CALI_MARK_END(comm);
+    BitonicMerge(lo, n, up);
+}
 
-    CALI_MARK_BEGIN(comp_large);  // Start computation region for large data sorting
-    // Sequential Sort
-    std::qsort(array, array_size, sizeof(int), ComparisonFunc);
-    CALI_MARK_END(comp_large);  // End computation region for large data sorting
+///////////////////////////////////////////////////
+// Generate Input
+///////////////////////////////////////////////////
+// Fills this rank's share of the size keys, which starts at global position added, and pads the
+// block with sentinels. Sorted inputs are sorted across ranks, not just within each rank
+void GenerateInput(char array_type, int size, int local_count, int added, std::mt19937 &gen) {
+    int i;
 
-    // Free allocated memory
-    delete[] buffer_send;
-    delete[] buffer_receive;
+    if (array_type == 's') {
+	// Generate sorted input for sorting (within each process)
+	for (i = 0; i < local_count; i++) {
+	    array[i] = i + added;
+	}
+    } else if (array_type == 'r') {
+	// Generate reverse sorted input for sorting (within each process)
+	for (i = 0; i < local_count; i++) {
+            array[i] = size - added - i;
+        }
+    } else if (array_type == 'p') {
+	// Generate sorted 1% perturbed input for sorting (within each process)
+	for (i = 0; i < local_count; i++) {
+	    array[i] = i + added;
+	}
+	if (local_count > 1) {
+	    for (i = 0; i < (local_count + 99) / 100; i++) {
+	        std::swap(array[gen() % local_count], array[gen() % local_count]);
+	    }
+	}
+    } else {
+	// Generate Random Numbers for Sorting (within each process)
+        for (i = 0; i < local_count; i++) {
+            array[i] = gen() % size;
+        }
+    }
+
+    // Sentinels sort past every real key
+    for (i = local_count; i < array_size; i++) {
+        array[i] = INT_MAX;
+    }
 }
 
 ///////////////////////////////////////////////////
@@ -157,13 +463,56 @@ void CompareHigh(int j) {
 int main(int argc, char *argv[]) {
     CALI_CXX_MARK_FUNCTION;
 
+    int pow;
+    char array_type;
+    int repetitions = 1;
+
+    if (argc >= 3) {
+        pow = atoi(argv[1]);
+        array_type = argv[2][0];
+
+        // Optional number of times to generate and sort a fresh input in one run
+        if (argc >= 4) {
+            repetitions = atoi(argv[3]);
+        }
+
+        if (pow < 0 || pow > 30) {
+            std::cout << "\n Power must be between 0 and 30." << std::endl;
+            return 0;
+        }
+
+        if (repetitions < 1) {
+            std::cout << "\n Repetitions must be at least 1." << std::endl;
+            return 0;
+        }
+    } else {
+        std::cout << "\n Please provide the power for the array size (ex. 16 for 2^16) and type of array ('u' for random/unsorted, 's' for sorted, 'r' for reverse sorted, 'p' for 1% perturbed) without quotation marks." << std::endl;
+        std::cout << " Optionally add the number of repetitions to sort that many fresh inputs in one run." << std::endl;
+        return 0;
+    }
+
+    const char* input_type;
+    if (array_type == 's') {
+        input_type = "Sorted";
+    } else if (array_type == 'r') {
+        input_type = "ReverseSorted";
+    } else if (array_type == 'p') {
+        input_type = "1_perc_perturbed";
+    } else {
+        if (array_type != 'u') {
+            std::cout << "Didn't correctly specify type of array, defaulting to random." << std::endl;
+        }
+        array_type = 'u';
+        input_type = "Random";
+    }
+
     // Create caliper ConfigManager object
     cali::ConfigManager mgr;
     mgr.start();
 
     CALI_MARK_BEGIN(mainFunc);
 
-    int i, j;
+    int i;
 
     CALI_MARK_BEGIN(comm);
 
@@ -172,109 +521,90 @@ int main(int argc, char *argv[]) {
     MPI_Comm_size(MPI_COMM_WORLD, &num_processes);
     MPI_Comm_rank(MPI_COMM_WORLD, &process_rank);
 
+    // Every rank seeds its own generator from one shared seed
+    unsigned int seed = time(NULL);
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+
     CALI_MARK_END(comm);
 
-    CALI_MARK_BEGIN(data_init_runtime);
+    std::mt19937 gen(seed + process_rank);
 
-    // Initialize Array for Storing Random Numbers
-    const char* input_type = "1_perc_perturbed";
-    int size = 1 << 16;
-    array_size = size / num_processes;
-    array = new int[array_size];
-    bool random = false;
-    bool sorted = false;
-    bool reverse = false;
-    bool perturbed = true;
+    int size = 1 << pow;
 
-    if (random){
-	// Generate Random Numbers for Sorting (within each process)
-        for (i = 0; i < array_size; i++) {
-            array[i] = rand() % (size);
-        }
-    }else if(sorted){
-	// Generate sorted input for sorting (within each process)
-	int added = process_rank * array_size;
-	for(i = 0; i < array_size; i++){
-	    array[i] = i + added;
-	}
-    }else if(reverse){
-	// Generate reverse sorted input for sorting (within each process)
-	int added = (num_processes - process_rank) * array_size;
-	array[0] = added;
-	for (i = 1; i < array_size; i++) {
-            array[i] = array[i-1] - 1;
-        }
-    }else if(perturbed){
-	// Generate sorted 1% perturbed input for sorting (within each process)
-	int added = process_rank * array_size;
-	for(i = 0; i < array_size; i++){
-	    array[i] = i + added;
-	}
-	int temp = array[0];
-	array[0] = array[1];
-	array[1] = temp;
+    // Each rank owns size / P keys, the first size % P ranks one more. Every block is
+    // padded to the same length with INT_MAX sentinels because compare-split trades whole blocks
+    int local_count = size / num_processes + (process_rank < size % num_processes);
+    int added = process_rank * (size / num_processes) + std::min(process_rank, size % num_processes);
+    int block_size = (size + num_processes - 1) / num_processes;
+    array = new int[block_size];
+    merge_buffer = new int[block_size];
+    recv_buffer = new int[block_size];
+    send_requests = new MPI_Request[(block_size + CHUNK_SIZE - 1) / CHUNK_SIZE + 1];
+    recv_requests = new MPI_Request[(block_size + CHUNK_SIZE - 1) / CHUNK_SIZE + 1];
+    send_head = new int[CHUNK_SIZE + 1];
+    recv_head = new int[CHUNK_SIZE + 1];
+
+    if (process_rank == 0) {
+        std::cout << "Number of Processes spawned: " << num_processes << std::endl;
+        std::cout << "Array Size: 2^" << pow << ", which is " << size << std::endl;
+        std::cout << "Array Type: " << input_type << std::endl;
     }
-    std::cout << std::endl;
 
+    for (int rep = 0; rep < repetitions; rep++) {
+        array_size = block_size;
 
-    srand(time(NULL));
+        CALI_MARK_BEGIN(data_init_runtime);
+        GenerateInput(array_type, size, local_count, added, gen);
+        CALI_MARK_END(data_init_runtime);
 
-    CALI_MARK_END(data_init_runtime);
+        CALI_MARK_BEGIN(comm);
+        // Blocks until all processes have finished generating
+        MPI_Barrier(MPI_COMM_WORLD);
+        CALI_MARK_END(comm);
 
-    CALI_MARK_BEGIN(comm);
-    // Blocks until all processes have finished generating
-    MPI_Barrier(MPI_COMM_WORLD);
-    CALI_MARK_END(comm);
+        // Start Timer before starting first sort operation
+        timer_start = MPI_Wtime();
 
+        CALI_MARK_BEGIN(comp_large);
+        // Sequential Sort
+        LocalSort(array, array_size, merge_buffer);
 
-    // Cube Dimension
-    int dimensions = static_cast<int>(std::log2(num_processes));
+        // Bitonic Sort follows
+        BitonicSort(0, num_processes, true);
+        CALI_MARK_END(comp_large);
 
-    // Start Timer before starting first sort operation
-    if (process_rank == 0) {
-        std::cout << "Number of Processes spawned: " << num_processes << std::endl;
-        timer_start = MPI_Wtime();
-    }
+        // The sentinels now fill the last global positions, drop them from the final blocks
+        array_size = std::max(0, std::min(array_size, size - process_rank * array_size));
 
-    CALI_MARK_BEGIN(comp_large);
-    // Sequential Sort
-    std::qsort(array, array_size, sizeof(int), ComparisonFunc);
-    
-    // Bitonic Sort follows
-    for (i = 0; i < dimensions; i++) {
-        for (j = i; j >= 0; j--) {
-            if (((process_rank >> (i + 1)) % 2 == 0 && (process_rank >> j) % 2 == 0) ||
-                ((process_rank >> (i + 1)) % 2 != 0 && (process_rank >> j) % 2 != 0)) {
-                CompareLow(j);
-            } else {
-                CompareHigh(j);
+        CALI_MARK_BEGIN(comm);
+        // Blocks until all processes have finished sorting
+        MPI_Barrier(MPI_COMM_WORLD);
+        CALI_MARK_END(comm);
+
+        timer_end = MPI_Wtime();
+
+        int works = 1;
+
+        CALI_MARK_BEGIN(correctness_check);
+        for (i = 1; i < array_size; i++) {
+            if (array[i-1] > array[i]) {
+                works = 0;
             }
         }
-    }
-    CALI_MARK_END(comp_large);
-
- 
-    CALI_MARK_BEGIN(comm);
-    // Blocks until all processes have finished sorting
-    MPI_Barrier(MPI_COMM_WORLD);
-    CALI_MARK_END(comm);
+        CALI_MARK_END(correctness_check);
 
-    bool works = true;
+        if (!works) {
+            std::cout << "process " << process_rank << " is not sorted" << std::endl;
+        }
 
-    CALI_MARK_BEGIN(correctness_check);
-    for (i = 1; i < array_size; i++) {
-        if(array[i-1] > array[i]) {	
-            works = false;
-	}
-    }
-    CALI_MARK_END(correctness_check);
+        int all_work;
+        MPI_Reduce(&works, &all_work, 1, MPI_INT, MPI_LAND, 0, MPI_COMM_WORLD);
 
-    if(works){
-	std::cout << "process " << process_rank << " is sorted.";
-    }else{
-	std::cout << "process " << process_rank << "is not sorted";
+        if (process_rank == 0) {
+            std::cout << "Repetition " << rep << ": " << (timer_end - timer_start) << " s, "
+                      << (all_work ? "every process is sorted." : "not sorted properly.") << std::endl;
+        }
     }
-    std::cout << std::endl;
 
 
     adiak::init(NULL);
@@ -288,6 +618,7 @@ int main(int argc, char *argv[]) {
     adiak::value("size_of_data_type", sizeof(int)); // sizeof(datatype) of input elements in bytes (e.g., 1, 2, 4)
     adiak::value("input_size", size); // The number of elements in input dataset (1000)
     adiak::value("input_type", input_type); // For sorting, this would be choices: ("Sorted", "ReverseSorted", "Random", "1_perc_perturbed")
+    adiak::value("repetitions", repetitions); // Number of inputs generated and sorted in this run
     adiak::value("num_procs", num_processes); // The number of processors (MPI ranks)
     adiak::value("scalability", "strong"); // The scalability of your algorithm. choices: ("strong", "weak")
     adiak::value("group_num", 4); // The number of your group (integer, e.g., 1, 10)
@@ -295,6 +626,12 @@ int main(int argc, char *argv[]) {
 
     // Free allocated memory
     delete[] array;
+    delete[] merge_buffer;
+    delete[] recv_buffer;
+    delete[] send_requests;
+    delete[] recv_requests;
+    delete[] send_head;
+    delete[] recv_head;
 
     // Done
 
@@ -8,78 +8,351 @@
 #include <algorithm>
 #include <random>
 #include <string>
+#include <climits>
 
 using namespace std;
 
-//merging vectors
-void merge(vector<int>& vec, int left, int mid, int right) {
-    int i, j, k;
-    int n1 = mid - left + 1;
-    int n2 = right - mid;
-
-    // Create temporary vectors
-    vector<int> leftVec(n1), rightVec(n2);
-
-    // Copy data to temporary vectors
-    for (i = 0; i < n1; i++)
-        leftVec[i] = vec[left + i];
-    for (j = 0; j < n2; j++)
-        rightVec[j] = vec[mid + 1 + j];
-
-    // Merge the temporary vectors back into vec[left..right]
-    i = 0;
-    j = 0;
-    k = left;
-    while (i < n1 && j < n2) {
-        if (leftVec[i] <= rightVec[j]) {
-            vec[k] = leftVec[i];
-            i++;
+// Runs shorter than this are extended with insertion sort before merging starts
+#define INSERTION_CUTOFF 24
+
+//merging runs src[left..mid] and src[mid + 1..right] into dst[left..right], stable
+void mergeRuns(const int* src, int* dst, int left, int mid, int right) {
+    int i = left;
+    int j = mid + 1;
+    int k = left;
+
+    // Runs that are already in order are copied through
+    if (src[mid] <= src[mid + 1]) {
+        copy(src + left, src + right + 1, dst + left);
+        return;
+    }
+
+    while (i <= mid && j <= right) {
+        if (src[i] <= src[j]) {
+            dst[k++] = src[i++];
         } else {
-            vec[k] = rightVec[j];
-            j++;
+            dst[k++] = src[j++];
         }
-        k++;
     }
 
-    while (i < n1) {
-        vec[k] = leftVec[i];
-        i++;
-        k++;
+    while (i <= mid) {
+        dst[k++] = src[i++];
     }
 
-    while (j < n2) {
-        vec[k] = rightVec[j];
-        j++;
-        k++;
+    while (j <= right) {
+        dst[k++] = src[j++];
     }
 }
 
-// Beggining process of mergeSort
+// Bottom-up merge sort of vec[left..right]. Natural runs are found first: ascending runs are kept,
+// strictly descending runs are reversed, and runs shorter than INSERTION_CUTOFF are extended with
+// insertion sort. Passes then merge neighbouring runs, ping-ponging between vec and one buffer,
+// so sorted input takes one linear scan and nearly sorted input only a few passes
 void mergeSort(vector<int>& vec, int left, int right) {
-    if (left < right) {
-      
-        // Calculate the midpoint
-        int mid = left + (right - left) / 2;
+    if (left >= right) {
+        return;
+    }
+
+    int* data = vec.data();
+
+    // Start of every run, closed by right + 1
+    vector<int> runs;
+    int start = left;
+    while (start <= right) {
+        int end = start + 1;
+        if (end <= right && data[end] < data[start]) {
+            while (end <= right && data[end] < data[end - 1]) {
+                end++;
+            }
+            reverse(data + start, data + end);
+        } else {
+            while (end <= right && data[end] >= data[end - 1]) {
+                end++;
+            }
+        }
+
+        // Insertion sort grows short runs, the first end - start keys are already in order
+        int target = min(start + INSERTION_CUTOFF, right + 1);
+        for (; end < target; end++) {
+            int key = data[end];
+            int i = end - 1;
+            while (i >= start && data[i] > key) {
+                data[i + 1] = data[i];
+                i--;
+            }
+            data[i + 1] = key;
+        }
+
+        runs.push_back(start);
+        start = end;
+    }
+    runs.push_back(right + 1);
+
+    vector<int> buffer(vec.size());
+    int* src = data;
+    int* dst = buffer.data();
+
+    while (runs.size() > 2) {
+        vector<int> merged_runs;
+        size_t r = 0;
+        for (; r + 2 < runs.size(); r += 2) {
+            mergeRuns(src, dst, runs[r], runs[r + 1] - 1, runs[r + 2] - 1);
+            merged_runs.push_back(runs[r]);
+        }
+
+        // An odd run out is carried over unchanged
+        if (r + 1 < runs.size()) {
+            copy(src + runs[r], src + runs[r + 1], dst + runs[r]);
+            merged_runs.push_back(runs[r]);
+        }
+        merged_runs.push_back(right + 1);
+
+        runs.swap(merged_runs);
+        swap(src, dst);
+    }
+
+    if (src != data) {
+        copy(src + left, src + right + 1, data + left);
+    }
+}
+
+// True when the head of run a should be output before the head of run b.
+// Exhausted runs lose every match and ties go to the lower run, which keeps the merge stable
+bool beats(const vector<int>& vec, const vector<int>& pos, const vector<int>& bounds, int a, int b) {
+    if (pos[a] == bounds[a + 1]) {
+        return false;
+    }
+    if (pos[b] == bounds[b + 1]) {
+        return true;
+    }
+    return vec[pos[a]] < vec[pos[b]] || (vec[pos[a]] == vec[pos[b]] && a < b);
+}
 
-        // Sort first and second halves
-        mergeSort(vec, left, mid);
-        mergeSort(vec, mid + 1, right);
+// K-way merge of the sorted runs vec[bounds[r], bounds[r + 1]) into out with a tournament (loser) tree.
+// Internal node i of the tree keeps the run that lost the match there and tree[0] the overall winner,
+// so each output key replays only the log2(k) matches on its leaf's path: O(n log k) in total
+void kWayMerge(const vector<int>& vec, const vector<int>& bounds, vector<int>& out) {
+    int k = bounds.size() - 1;
+    int n = bounds[k] - bounds[0];
+    vector<int> pos(bounds.begin(), bounds.end() - 1);
+    vector<int> tree(k);
 
-        // Merge the sorted halves
-        merge(vec, left, mid, right);
+    // Build bottom-up, leaves k .. 2k - 1 are the runs
+    vector<int> winner(2 * k);
+    for (int r = 0; r < k; r++) {
+        winner[k + r] = r;
+    }
+    for (int node = k - 1; node >= 1; node--) {
+        int a = winner[2 * node];
+        int b = winner[2 * node + 1];
+        winner[node] = beats(vec, pos, bounds, a, b) ? a : b;
+        tree[node] = beats(vec, pos, bounds, a, b) ? b : a;
+    }
+    tree[0] = winner[1];
+
+    out.resize(n);
+    for (int i = 0; i < n; i++) {
+        int w = tree[0];
+        out[i] = vec[pos[w]];
+        pos[w]++;
+
+        // Replay the winner's path against the stored losers
+        for (int node = (w + k) / 2; node >= 1; node /= 2) {
+            if (beats(vec, pos, bounds, tree[node], w)) {
+                swap(tree[node], w);
+            }
+        }
+        tree[0] = w;
     }
 }
 
+// Binary-tree merge across ranks: at each of the log2(P) steps the rank stride above a multiple of
+// 2 * stride sends its sorted run down to that rank, which merges the two runs. The root only ever
+// receives one run per step and the merge work is spread over the ranks until the last step
+void treeMerge(vector<int>& sub_array, int world_rank, int world_size) {
+    vector<int> incoming, merged;
+
+    for (int stride = 1; stride < world_size; stride *= 2) {
+        if (world_rank % (2 * stride) == stride) {
+            CALI_MARK_BEGIN("comm");
+            CALI_MARK_BEGIN("comm_large");
+            MPI_Send(sub_array.data(), sub_array.size(), MPI_INT, world_rank - stride, 0, MPI_COMM_WORLD);
+            CALI_MARK_END("comm_large");
+            CALI_MARK_END("comm");
+            sub_array.clear();
+            return;
+        }
+
+        int partner = world_rank + stride;
+        if (partner >= world_size) {
+            continue;
+        }
+
+        // The partner's run grows each step, so take its length from the message
+        CALI_MARK_BEGIN("comm");
+        CALI_MARK_BEGIN("comm_large");
+        MPI_Status status;
+        int count;
+        MPI_Probe(partner, 0, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_INT, &count);
+        incoming.resize(count);
+        MPI_Recv(incoming.data(), count, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        CALI_MARK_END("comm_large");
+        CALI_MARK_END("comm");
+
+        CALI_MARK_BEGIN("comp");
+        CALI_MARK_BEGIN("comp_large");
+        merged.resize(sub_array.size() + incoming.size());
+        std::merge(sub_array.begin(), sub_array.end(), incoming.begin(), incoming.end(), merged.begin());
+        sub_array.swap(merged);
+        CALI_MARK_END("comp_large");
+        CALI_MARK_END("comp");
+    }
+}
+
+// Distributed merge: co-rank split points into all runs, then each rank merges its equal slice
+void pathMerge(vector<int>& run, int n, int world_rank, int world_size) {
+    int inner = world_size - 1;
+    vector<int> target(world_size + 1);
+    for (int k = 0; k <= world_size; k++) {
+        target[k] = (long long) k * n / world_size;
+    }
+
+    CALI_MARK_BEGIN("comm");
+    CALI_MARK_BEGIN("comm_small");
+    int local_min = run.empty() ? INT_MAX : run.front();
+    int local_max = run.empty() ? INT_MIN : run.back();
+    int global_min, global_max;
+    MPI_Allreduce(&local_min, &global_min, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&local_max, &global_max, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    CALI_MARK_END("comm_small");
+    CALI_MARK_END("comm");
+
+    // Smallest key v[k] with at least target[k + 1] keys <= v[k], the bounds are the same on every rank
+    vector<long long> lo(inner, global_min), hi(inner, global_max);
+    vector<int> local_count(inner), global_count(inner);
+    while (true) {
+        bool searching = false;
+        for (int k = 0; k < inner; k++) {
+            long long mid = lo[k] + (hi[k] - lo[k]) / 2;
+            local_count[k] = upper_bound(run.begin(), run.end(), mid) - run.begin();
+            searching = searching || lo[k] < hi[k];
+        }
+        if (!searching) {
+            break;
+        }
+
+        CALI_MARK_BEGIN("comm");
+        CALI_MARK_BEGIN("comm_small");
+        MPI_Allreduce(local_count.data(), global_count.data(), inner, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        CALI_MARK_END("comm_small");
+        CALI_MARK_END("comm");
+
+        for (int k = 0; k < inner; k++) {
+            long long mid = lo[k] + (hi[k] - lo[k]) / 2;
+            if (global_count[k] >= target[k + 1]) {
+                hi[k] = mid;
+            } else {
+                lo[k] = mid + 1;
+            }
+        }
+    }
+
+    // Keys below v[k] stay left of the split, ties with v[k] fill the remaining slots in rank order
+    vector<int> less(inner), ties(inner), global_less(inner), ties_before(inner, 0);
+    for (int k = 0; k < inner; k++) {
+        less[k] = lower_bound(run.begin(), run.end(), lo[k]) - run.begin();
+        ties[k] = upper_bound(run.begin(), run.end(), lo[k]) - run.begin() - less[k];
+    }
+
+    CALI_MARK_BEGIN("comm");
+    CALI_MARK_BEGIN("comm_small");
+    MPI_Allreduce(less.data(), global_less.data(), inner, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Exscan(ties.data(), ties_before.data(), inner, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    CALI_MARK_END("comm_small");
+    CALI_MARK_END("comm");
+
+    // MPI_Exscan leaves the receive buffer undefined on rank 0
+    if (world_rank == 0) {
+        fill(ties_before.begin(), ties_before.end(), 0);
+    }
+
+    vector<int> send_counts(world_size), send_displs(world_size), recv_counts(world_size), recv_displs(world_size);
+    int previous = 0;
+    for (int k = 0; k < world_size; k++) {
+        int split = run.size();
+        if (k < inner) {
+            int extra = target[k + 1] - global_less[k] - ties_before[k];
+            split = less[k] + max(0, min(extra, ties[k]));
+        }
+        send_displs[k] = previous;
+        send_counts[k] = split - previous;
+        previous = split;
+    }
+
+    CALI_MARK_BEGIN("comm");
+    CALI_MARK_BEGIN("comm_small");
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    CALI_MARK_END("comm_small");
+    CALI_MARK_END("comm");
+
+    vector<int> bounds(world_size + 1, 0);
+    for (int r = 0; r < world_size; r++) {
+        recv_displs[r] = bounds[r];
+        bounds[r + 1] = bounds[r] + recv_counts[r];
+    }
+
+    vector<int> received(bounds[world_size]);
+    CALI_MARK_BEGIN("comm");
+    CALI_MARK_BEGIN("comm_large");
+    MPI_Alltoallv(run.data(), send_counts.data(), send_displs.data(), MPI_INT,
+                  received.data(), recv_counts.data(), recv_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    CALI_MARK_END("comm_large");
+    CALI_MARK_END("comm");
+
+    CALI_MARK_BEGIN("comp");
+    CALI_MARK_BEGIN("comp_large");
+    kWayMerge(received, bounds, run);
+    CALI_MARK_END("comp_large");
+    CALI_MARK_END("comp");
+}
+
+// True on every rank when each slice is sorted, every slice ends at or below the next one
+// and the slices hold n keys in total
+bool distributedIsSorted(const vector<int>& vec, int n, int world_rank) {
+    int ok = is_sorted(vec.begin(), vec.end());
+
+    // The largest key on any lower rank must not exceed this slice's first key
+    int last = vec.empty() ? INT_MIN : vec.back();
+    int carry = INT_MIN;
+    MPI_Exscan(&last, &carry, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (world_rank > 0 && !vec.empty()) {
+        ok = ok && carry <= vec.front();
+    }
+
+    // Count unsorted slices and keys together
+    int local[2] = {!ok, (int) vec.size()}, global[2];
+    MPI_Allreduce(local, global, 2, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return global[0] == 0 && global[1] == n;
+}
+
 //Parallel Merge Sort Implementation based upon https://www.christianbaun.de/CGC18/Skript/MPI_TASK_2_Presentation.pdf
-void parallelMergeSort(vector<int>& vec, int n, int world_rank, int world_size) {
+// merge_mode "tree" merges pairwise across ranks, "root" gathers every run to rank 0 and merges there,
+// "path" leaves an equal contiguous slice of the sorted keys in vec on every rank
+void parallelMergeSort(vector<int>& vec, int n, int world_rank, int world_size, const string& merge_mode) {
     CALI_MARK_BEGIN("comm");
-    // Divide the array into chunks
-    int size = n / world_size;
+    // Divide the array into balanced chunks, the first n % world_size ranks take one extra element
+    vector<int> counts(world_size), displs(world_size + 1, 0);
+    for (int r = 0; r < world_size; r++) {
+        counts[r] = n / world_size + (r < n % world_size);
+        displs[r + 1] = displs[r] + counts[r];
+    }
+    int size = counts[world_rank];
     vector<int> sub_array(size);
 
     // Scatter the array to all processes
     CALI_MARK_BEGIN("comm_large");
-    MPI_Scatter(vec.data(), size, MPI_INT, sub_array.data(), size, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(vec.data(), counts.data(), displs.data(), MPI_INT, sub_array.data(), size, MPI_INT, 0, MPI_COMM_WORLD);
     CALI_MARK_END("comm_large");
     CALI_MARK_END("comm");
     // Perform merge sort on each process's chunk
@@ -88,6 +361,21 @@ void parallelMergeSort(vector<int>& vec, int n, int world_rank, int world_size)
     mergeSort(sub_array, 0, size - 1);
     CALI_MARK_END("comp_large");
     CALI_MARK_END("comp");
+
+    if (merge_mode == "path") {
+        pathMerge(sub_array, n, world_rank, world_size);
+        vec.swap(sub_array);
+        return;
+    }
+
+    if (merge_mode == "tree") {
+        treeMerge(sub_array, world_rank, world_size);
+        if (world_rank == 0) {
+            vec.swap(sub_array);
+        }
+        return;
+    }
+
     // Gather the sorted subarrays at the root process
     vector<int> sorted;
     if (world_rank == 0) {
@@ -95,26 +383,17 @@ void parallelMergeSort(vector<int>& vec, int n, int world_rank, int world_size)
     }
     CALI_MARK_BEGIN("comm");
     CALI_MARK_BEGIN("comm_large");
-    MPI_Gather(sub_array.data(), size, MPI_INT, sorted.data(), size, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(sub_array.data(), size, MPI_INT, sorted.data(), counts.data(), displs.data(), MPI_INT, 0, MPI_COMM_WORLD);
     CALI_MARK_END("comm_large");
     CALI_MARK_END("comm");
     // Perform final merge at the root process
     if (world_rank == 0) {
-        // Handle remaining elements if n is not perfectly divisible
-        int remaining_elements = n % world_size;
-        if (remaining_elements > 0) {
-            vector<int> remaining(remaining_elements);
-            MPI_Recv(remaining.data(), remaining_elements, MPI_INT, world_size - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            sorted.insert(sorted.end(), remaining.begin(), remaining.end());
-        }
-        
-        // Merge all sorted arrays
+        // Merge all sorted arrays, every rank's chunk is already a sorted run
         CALI_MARK_BEGIN("comp");
         CALI_MARK_BEGIN("comp_large");
-        mergeSort(sorted, 0, n - 1);
+        kWayMerge(sorted, displs, vec);
         CALI_MARK_END("comp_large");
         CALI_MARK_END("comp");
-        vec = sorted;
     }
 }
 
@@ -127,6 +406,15 @@ int main(int argc, char* argv[]) {
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
     int array_size = std::atoi(argv[1]);
     string input_type = argv[3];
+    // Optional merge across ranks: "tree" (default), "root" or "path" for output distributed over the ranks
+    string merge_mode = argc > 4 ? argv[4] : "tree";
+    if (merge_mode != "tree" && merge_mode != "root" && merge_mode != "path") {
+        if (world_rank == 0) {
+            cout << "Unknown merge mode '" << merge_mode << "', expected 'tree', 'root' or 'path'." << endl;
+        }
+        MPI_Finalize();
+        return 0;
+    }
     vector<int> vec;
     adiak::init(NULL);
     adiak::launchdate();    // launch date of the job
@@ -139,6 +427,7 @@ int main(int argc, char* argv[]) {
     adiak::value("size_of_data_type", sizeof(int)); // sizeof(datatype) of input elements in bytes (e.g., 1, 2, 4)
     adiak::value("input_size", array_size); // The number of elements in input dataset (1000)
     adiak::value("input_type", input_type); // For sorting, this would be choices: ("Sorted", "ReverseSorted", "Random", "1_perc_perturbed")
+    adiak::value("merge_mode", merge_mode); // How the sorted runs are merged across ranks
     adiak::value("num_procs", world_size); // The number of processors (MPI ranks)
     adiak::value("scalability", "strong"); // The scalability of your algorithm. choices: ("strong", "weak")
     adiak::value("group_num", "4"); // The number of your group (integer, e.g., 1, 10)
@@ -180,13 +469,16 @@ int main(int argc, char* argv[]) {
     }
     }
     CALI_MARK_END("data_init_runtime");
-    parallelMergeSort(vec, array_size, world_rank, world_size);
+    parallelMergeSort(vec, array_size, world_rank, world_size, merge_mode);
 
     CALI_MARK_BEGIN("correctness_check");
+    // Each rank holds one slice in path mode, otherwise rank 0 holds everything
+    bool distributed_ok = merge_mode == "path" && distributedIsSorted(vec, array_size, world_rank);
     if(world_rank == 0){
-        if(is_sorted(vec.begin(), vec.end())){
-            // cout << "The vector is sorted!" << endl;
-            // cout << world_size << endl;
+        if(merge_mode == "path" ? distributed_ok : is_sorted(vec.begin(), vec.end())){
+            cout << "The vector is sorted!" << endl;
+        } else {
+            cout << "The vector is NOT sorted!" << endl;
         }
     }
     CALI_MARK_END("correctness_check");
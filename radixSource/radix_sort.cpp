@@ -10,64 +10,472 @@
 #include "mpi.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <ctime>
 #include <random>
 #include <algorithm>
+#include <string>
 
 #include <caliper/cali.h>
 #include <caliper/cali-manager.h>
 #include <adiak.hpp>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Caliper regions only mark phases, never single keys. Build with RADIX_NO_ANNOTATIONS
+// (cmake -DRADIX_ANNOTATIONS=OFF) to compile out every region and the per-pass counters
+// (timestamps, PassStats and radix_routed_bytes) for production runs
+#ifdef RADIX_NO_ANNOTATIONS
+#define RADIX_MARK_FUNCTION
+#define RADIX_MARK_BEGIN(name)
+#define RADIX_MARK_END(name)
+#else
+#define RADIX_MARK_FUNCTION CALI_CXX_MARK_FUNCTION
+#define RADIX_MARK_BEGIN(name) CALI_MARK_BEGIN(name)
+#define RADIX_MARK_END(name) CALI_MARK_END(name)
+#endif
+
 #define MASTER 0 // taskid of root process
+#define DEFAULT_DIGIT_BITS 8 // bits per radix digit (2^8 = 256 buckets)
+#define MAX_DIGIT_BITS 16 // largest digit width accepted on the command line
+#define WC_BYTES 64 // size of one write-combining buffer in the local scatter (a cache line)
+#define WC_MAX_BUCKETS 4096 // widest digit that still uses write-combining buffers
+#define THREAD_MIN_KEYS (1 << 16) // smallest local array worth splitting over threads
+#define MSD_BITS 16 // top bits used to pick each key's final rank in the MSD exchange
+#define MSD_REFINE_BITS 8 // further bits used to split MSD buckets that hold over an eighth of a rank's share
+
+// How keys are redistributed between ranks
+enum ExchangeMode {
+    EXCHANGE_ALLTOALLV, // one contiguous MPI_Alltoallv of values per LSD digit
+    EXCHANGE_PAIRS,     // original (value, index) point-to-point messaging per LSD digit
+    EXCHANGE_MSD        // one MSD partition exchange, then purely local LSD passes
+};
+
+const char* exchangeNames[] = {"alltoallv", "pairs", "msd"};
+
+// Threads used by the local counting sort on each rank (hybrid MPI + OpenMP), set from the command line
+int radixThreads = 1;
+
+// Names for use in caliper regions
+const char* data_init_runtime = "data_init_runtime";
+const char* comm = "comm";
+const char* comm_small = "comm_small";
+const char* comm_large = "comm_large";
+const char* comp = "comp";
+const char* comp_small = "comp_small";
+const char* comp_large = "comp_large";
+const char* correctness_check = "correctness_check";
+
+#ifndef RADIX_NO_ANNOTATIONS
+// Counters for one pass of a per-key routing loop, kept in locals and published once per pass
+struct PassStats {
+    int pass;
+    long long elements; // keys routed
+    long long bytes;    // bytes packed for the exchange
+    long long ticks;    // time spent in the loop, TSC cycles on x86 and nanoseconds elsewhere
+};
+
+// Cheap timestamp for PassStats
+inline long long readTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return (long long) __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Publishes one pass worth of counters as Caliper attributes
+void publishPassStats(const PassStats &stats) {
+    cali_set_int_byname("radix.pass", stats.pass);
+    cali_set_double_byname("radix.pass.elements", (double) stats.elements);
+    cali_set_double_byname("radix.pass.bytes", (double) stats.bytes);
+    cali_set_double_byname("radix.pass.ticks", (double) stats.ticks);
+}
+#endif
+
+// Order-preserving mapping of each supported key type onto unsigned bits, so that
+// comparing the encoded bits as unsigned integers gives the same order as the keys
+template <typename T> struct RadixKey;
+
+// Signed integers: flip the sign bit so negatives come before positives
+template <> struct RadixKey<int32_t> {
+    typedef uint32_t Bits;
+    static const char* name() { return "int"; }
+    static Bits encode(int32_t key) { return (uint32_t) key ^ 0x80000000u; }
+    static int32_t decode(Bits bits) { return (int32_t) (bits ^ 0x80000000u); }
+};
+
+template <> struct RadixKey<int64_t> {
+    typedef uint64_t Bits;
+    static const char* name() { return "int64_t"; }
+    static Bits encode(int64_t key) { return (uint64_t) key ^ 0x8000000000000000ull; }
+    static int64_t decode(Bits bits) { return (int64_t) (bits ^ 0x8000000000000000ull); }
+};
+
+template <> struct RadixKey<uint64_t> {
+    typedef uint64_t Bits;
+    static const char* name() { return "uint64_t"; }
+    static Bits encode(uint64_t key) { return key; }
+    static uint64_t decode(Bits bits) { return bits; }
+};
+
+// IEEE floats: set the sign bit of positives, invert all bits of negatives
+template <> struct RadixKey<float> {
+    typedef uint32_t Bits;
+    static const char* name() { return "float"; }
+    static Bits encode(float key) {
+        uint32_t bits;
+        memcpy(&bits, &key, sizeof(bits));
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+    static float decode(Bits bits) {
+        bits = (bits & 0x80000000u) ? (bits ^ 0x80000000u) : ~bits;
+        float key;
+        memcpy(&key, &bits, sizeof(key));
+        return key;
+    }
+};
+
+template <> struct RadixKey<double> {
+    typedef uint64_t Bits;
+    static const char* name() { return "double"; }
+    static Bits encode(double key) {
+        uint64_t bits;
+        memcpy(&bits, &key, sizeof(bits));
+        return (bits & 0x8000000000000000ull) ? ~bits : (bits | 0x8000000000000000ull);
+    }
+    static double decode(Bits bits) {
+        bits = (bits & 0x8000000000000000ull) ? (bits ^ 0x8000000000000000ull) : ~bits;
+        double key;
+        memcpy(&key, &bits, sizeof(key));
+        return key;
+    }
+};
+
+// MPI datatype used to move encoded keys
+template <typename Bits> MPI_Datatype bitsType();
+template <> MPI_Datatype bitsType<uint32_t>() { return MPI_UINT32_T; }
+template <> MPI_Datatype bitsType<uint64_t>() { return MPI_UINT64_T; }
+
+// MPI datatype used to move the original keys
+template <typename T> MPI_Datatype keyType();
+template <> MPI_Datatype keyType<int32_t>() { return MPI_INT32_T; }
+template <> MPI_Datatype keyType<int64_t>() { return MPI_INT64_T; }
+template <> MPI_Datatype keyType<uint64_t>() { return MPI_UINT64_T; }
+template <> MPI_Datatype keyType<float>() { return MPI_FLOAT; }
+template <> MPI_Datatype keyType<double>() { return MPI_DOUBLE; }
+
+// Random input keys for each supported type, signed and floating point types also produce negatives
+template <typename T> T randomKey(std::mt19937_64 &gen, int sizeLimit);
+
+template <> int32_t randomKey<int32_t>(std::mt19937_64 &gen, int sizeLimit) {
+    return std::uniform_int_distribution<int32_t>(-sizeLimit, sizeLimit - 1)(gen);
+}
+
+template <> int64_t randomKey<int64_t>(std::mt19937_64 &gen, int sizeLimit) {
+    int64_t limit = (int64_t) sizeLimit * sizeLimit;
+    return std::uniform_int_distribution<int64_t>(-limit, limit - 1)(gen);
+}
 
-// Helper function for finding max value in an array
-int findMax(int *arr, int n) {
-    int maxVal = arr[0];
+template <> uint64_t randomKey<uint64_t>(std::mt19937_64 &gen, int sizeLimit) {
+    return gen() % ((uint64_t) sizeLimit * sizeLimit);
+}
+
+template <> float randomKey<float>(std::mt19937_64 &gen, int sizeLimit) {
+    return std::uniform_real_distribution<float>(-sizeLimit, sizeLimit)(gen);
+}
+
+template <> double randomKey<double>(std::mt19937_64 &gen, int sizeLimit) {
+    return std::uniform_real_distribution<double>(-sizeLimit, sizeLimit)(gen);
+}
+
+// Helper function for finding the min and max encoded keys in an array, an empty array gives min > max
+template <typename Bits>
+void findMinMax(Bits *arr, int n, Bits &minVal, Bits &maxVal) {
+    minVal = ~(Bits) 0;
+    maxVal = 0;
     for (int i = 0; i < n; i++) {
+        if (arr[i] < minVal) { minVal = arr[i]; }
         if (arr[i] > maxVal) { maxVal = arr[i]; }
     }
+}
 
-    return maxVal;
+// Number of significant bits in val (0 when val is 0)
+template <typename Bits>
+int bitWidth(Bits val) {
+    int width = 0;
+    while (val > 0) {
+        val >>= 1;
+        width++;
+    }
+
+    return width;
 }
 
-// Counting sort, stable implementation, goes digit by digit
-void countingSort(int *arr, int *count, int n, int exp) {
-    int *tempArr =  new int[n];
+// Number of digit passes needed to sort keys whose encoded min and max differ in keyRange (min ^ max).
+// Every bit above the highest set bit of keyRange is shared by all keys and never needs a pass
+template <typename Bits>
+int numPasses(Bits keyRange, int digitBits) {
+    return (bitWidth(keyRange) + digitBits - 1) / digitBits;
+}
 
-    // Use this array to store the values of each digit and repurpose to hold the sum of other counts
-    int rollingCount[10];
+// Extracts the digit of val that starts at bit position shift
+template <typename Bits>
+inline int getDigit(Bits val, int shift, int mask) {
+    return (int) ((val >> shift) & mask);
+}
 
-    for (int i = 0; i < n; i++) {
-        count[(arr[i] / exp) % 10]++;
+// Looks for an optional "name=value" argument after the required ones, returns NULL if missing
+const char* findOption(int argc, char *argv[], const char *name) {
+    size_t len = strlen(name);
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+            return argv[i] + len + 1;
+        }
     }
 
-    // Copy the counts to the rolling/working count array
-    for (int i = 0; i < 10; i++) {
-        rollingCount[i] = count[i];
+    return NULL;
+}
+
+// Histogram of the digit that is digitBits wide and starts at bit position shift, count must hold 2^digitBits entries.
+// Counts into four interleaved histograms so runs of equal digits do not serialize on one counter
+template <typename Bits>
+void countChunk(const Bits *arr, int *count, int n, int shift, int digitBits) {
+    int buckets = 1 << digitBits;
+    int mask = buckets - 1;
+    int *hist = new int[4 * buckets]();
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        hist[getDigit(arr[i], shift, mask)]++;
+        hist[buckets + getDigit(arr[i + 1], shift, mask)]++;
+        hist[2 * buckets + getDigit(arr[i + 2], shift, mask)]++;
+        hist[3 * buckets + getDigit(arr[i + 3], shift, mask)]++;
     }
 
-    // Sum the values
-    for (int i = 1; i < 10; i++) {
-        rollingCount[i] += rollingCount[i - 1];
+    for (; i < n; i++) {
+        hist[getDigit(arr[i], shift, mask)]++;
     }
 
-    // Move input values according to rollingCount
-    for (int i = n - 1; i >= 0; i--) {
-        int index = (arr[i] / exp) % 10;
-        tempArr[rollingCount[index] - 1] = arr[i];
-        rollingCount[index]--;
+    for (int b = 0; b < buckets; b++) {
+        count[b] += hist[b] + hist[buckets + b] + hist[2 * buckets + b] + hist[3 * buckets + b];
     }
 
+    delete[] hist;
+}
+
+// Stable scatter of src into dst by digit, rollingCount holds the next output slot of each digit and is advanced.
+// Keys are staged in a cache-line sized write-combining buffer per bucket and written out a full line
+// at a time, which keeps the number of destination lines and pages touched at once small
+template <typename Bits>
+void scatterChunk(const Bits *src, Bits *dst, int *rollingCount, int n, int shift, int digitBits) {
+    int buckets = 1 << digitBits;
+    int mask = buckets - 1;
+
+    // Buffers for very wide digits no longer fit in cache, scatter directly instead
+    if (buckets > WC_MAX_BUCKETS) {
+        for (int i = 0; i < n; i++) {
+            int index = getDigit(src[i], shift, mask);
+            dst[rollingCount[index]++] = src[i];
+        }
+
+        return;
+    }
+
+    const int wcSize = WC_BYTES / sizeof(Bits);
+    Bits *wcStorage = new Bits[(buckets + 1) * wcSize];
+    int *wcFill = new int[buckets]();
+
+    // Align the buffers to cache lines
+    uintptr_t misalign = reinterpret_cast<uintptr_t>(wcStorage) % WC_BYTES;
+    Bits *wc = wcStorage + (misalign ? (WC_BYTES - misalign) / sizeof(Bits) : 0);
+
     for (int i = 0; i < n; i++) {
-        arr[i] = tempArr[i];
+        int index = getDigit(src[i], shift, mask);
+        Bits *buffer = wc + index * wcSize;
+        buffer[wcFill[index]++] = src[i];
+
+        if (wcFill[index] == wcSize) {
+            std::copy(buffer, buffer + wcSize, dst + rollingCount[index]);
+            rollingCount[index] += wcSize;
+            wcFill[index] = 0;
+        }
+    }
+
+    // Flush partially filled buffers
+    for (int i = 0; i < buckets; i++) {
+        std::copy(wc + i * wcSize, wc + i * wcSize + wcFill[i], dst + rollingCount[i]);
+        rollingCount[i] += wcFill[i];
+    }
+
+    delete[] wcStorage;
+    delete[] wcFill;
+}
+
+// True when the local kernels should split n keys over the rank's threads
+bool useThreads(int n) {
+    return radixThreads > 1 && n >= THREAD_MIN_KEYS;
+}
+
+// Turns per-thread digit histograms into per-thread output slots. Digit-major, thread-minor order
+// keeps equal digits in input order, so the scatter stays stable. Adds the histogram to count when
+// count is not NULL
+void threadOffsets(int *threadCounts, int *count, int threads, int buckets) {
+    int sum = 0;
+    for (int b = 0; b < buckets; b++) {
+        for (int i = 0; i < threads; i++) {
+            int c = threadCounts[i * buckets + b];
+            threadCounts[i * buckets + b] = sum;
+            sum += c;
+
+            if (count != NULL) {
+                count[b] += c;
+            }
+        }
+    }
+}
+
+// Thread-parallel stable scatter: each thread histograms one contiguous chunk, a prefix sum over
+// (digit, thread) gives every thread its own output slots, then each thread scatters its chunk.
+// Adds the histogram to count when count is not NULL
+template <typename Bits>
+void threadedScatter(const Bits *src, Bits *dst, int *count, int n, int shift, int digitBits) {
+    int buckets = 1 << digitBits;
+    int threads = radixThreads;
+    int *threadCounts = new int[threads * buckets]();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int t = 0;
+#ifdef _OPENMP
+        t = omp_get_thread_num();
+#endif
+        int begin = (int) ((long long) n * t / threads);
+        int end = (int) ((long long) n * (t + 1) / threads);
+        int *own = threadCounts + t * buckets;
+
+        countChunk(src + begin, own, end - begin, shift, digitBits);
+
+        #pragma omp barrier
+        #pragma omp single
+        threadOffsets(threadCounts, count, threads, buckets);
+
+        scatterChunk(src + begin, dst, own, end - begin, shift, digitBits);
+    }
+
+    delete[] threadCounts;
+}
+
+// Histogram of the digit that is digitBits wide and starts at bit position shift, count must hold 2^digitBits entries.
+// On the threaded path the per-thread histograms are left in keepCounts (radixThreads * 2^digitBits entries)
+// when it is not NULL, so scatterByDigit can reuse them instead of recounting
+template <typename Bits>
+void countDigits(const Bits *arr, int *count, int n, int shift, int digitBits, int *keepCounts = NULL) {
+    if (!useThreads(n)) {
+        countChunk(arr, count, n, shift, digitBits);
+        return;
+    }
+
+    int buckets = 1 << digitBits;
+    int threads = radixThreads;
+    int *threadCounts = keepCounts != NULL ? keepCounts : new int[threads * buckets];
+    std::fill(threadCounts, threadCounts + threads * buckets, 0);
+
+    #pragma omp parallel for num_threads(threads)
+    for (int t = 0; t < threads; t++) {
+        int begin = (int) ((long long) n * t / threads);
+        int end = (int) ((long long) n * (t + 1) / threads);
+        countChunk(arr + begin, threadCounts + t * buckets, end - begin, shift, digitBits);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        for (int b = 0; b < buckets; b++) {
+            count[b] += threadCounts[t * buckets + b];
+        }
+    }
+
+    if (threadCounts != keepCounts) {
+        delete[] threadCounts;
+    }
+}
+
+// Stable scatter of src into dst by the digit whose histogram countDigits already stored in count.
+// Threads scatter from the per-thread histograms countDigits kept in threadCounts, or recount when it is NULL
+template <typename Bits>
+void scatterByDigit(const Bits *src, Bits *dst, const int *count, int n, int shift, int digitBits, int *threadCounts = NULL) {
+    if (useThreads(n) && threadCounts == NULL) {
+        threadedScatter(src, dst, (int *) NULL, n, shift, digitBits);
+        return;
+    }
+
+    if (useThreads(n)) {
+        int buckets = 1 << digitBits;
+        int threads = radixThreads;
+        threadOffsets(threadCounts, NULL, threads, buckets);
+
+        #pragma omp parallel for num_threads(threads)
+        for (int t = 0; t < threads; t++) {
+            int begin = (int) ((long long) n * t / threads);
+            int end = (int) ((long long) n * (t + 1) / threads);
+            scatterChunk(src + begin, dst, threadCounts + t * buckets, end - begin, shift, digitBits);
+        }
+        return;
     }
 
-    delete[] tempArr;
+    int buckets = 1 << digitBits;
+
+    // Use this array to hold the next output slot of each digit
+    int *rollingCount = new int[buckets];
+
+    int sum = 0;
+    for (int i = 0; i < buckets; i++) {
+        rollingCount[i] = sum;
+        sum += count[i];
+    }
+
+    scatterChunk(src, dst, rollingCount, n, shift, digitBits);
+
+    delete[] rollingCount;
+}
+
+// Counting sort, stable implementation, goes digit by digit
+// The digit is digitBits wide and starts at bit position shift, count must hold 2^digitBits entries.
+// Reads src and writes the sorted keys to dst, callers ping-pong the two buffers between passes
+template <typename Bits>
+void countingSort(const Bits *src, Bits *dst, int *count, int n, int shift, int digitBits) {
+    if (useThreads(n)) {
+        threadedScatter(src, dst, count, n, shift, digitBits);
+        return;
+    }
+
+    countDigits(src, count, n, shift, digitBits);
+    scatterByDigit(src, dst, count, n, shift, digitBits);
+}
+
+// True when a single digit value holds all total keys, in which case a pass would not move anything
+bool uniformDigit(int *globalCount, int buckets, int total) {
+    for (int i = 0; i < buckets; i++) {
+        if (globalCount[i] == total) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 // Used to directly compare two arrays for use in checking correctness
-int compareArrays(int *seqArr, int *parallelArr, int n) {
+template <typename T>
+int compareArrays(T *seqArr, T *parallelArr, int n) {
     for (int i = 0; i < n; i++) {
         if (seqArr[i] != parallelArr[i]) {
             return 0;
@@ -76,93 +484,293 @@ int compareArrays(int *seqArr, int *parallelArr, int n) {
     return 1;
 }
 
+// LSD radix sort of encoded keys in a single array, only the bits where the keys differ get a pass
+template <typename Bits>
+void radixSortBits(Bits *bits, int n, int digitBits) {
+    if (n == 0) {
+        return;
+    }
+
+    Bits minVal, maxVal;
+    findMinMax(bits, n, minVal, maxVal);
+    int passes = numPasses<Bits>(minVal ^ maxVal, digitBits);
+    int *count = new int[1 << digitBits];
+
+    // Ping-pong between the input and one scratch buffer
+    Bits *src = bits;
+    Bits *dst = new Bits[n];
+    Bits *scratch = dst;
+
+    for (int pass = 0; pass < passes; pass++) {
+        std::fill(count, count + (1 << digitBits), 0);
+        countingSort(src, dst, count, n, pass * digitBits, digitBits);
+        std::swap(src, dst);
+    }
+
+    // Only copy back when an odd number of passes left the keys in the scratch buffer
+    if (src != bits) {
+        std::copy(src, src + n, bits);
+    }
+
+    delete[] count;
+    delete[] scratch;
+}
+
 // Sequential implementation of Radix Sort for comparing end results
-void sequentialRadix(int *arr, int n) {
-    int maxVal = findMax(arr, n);
+template <typename T>
+void sequentialRadix(T *arr, int n, int digitBits) {
+    typedef typename RadixKey<T>::Bits Bits;
 
-    for (int exp = 1; maxVal / exp > 0; exp *= 10) {
-        int count[10] = {0};
-        countingSort(arr, count, n, exp);
+    Bits *bits = new Bits[n];
+    for (int i = 0; i < n; i++) {
+        bits[i] = RadixKey<T>::encode(arr[i]);
     }
+
+    radixSortBits(bits, n, digitBits);
+
+    for (int i = 0; i < n; i++) {
+        arr[i] = RadixKey<T>::decode(bits[i]);
+    }
+
+    delete[] bits;
 }
 
-// Check the correctness of the parallelized vs sequential version of Radix Sort
-int correctnessCheck(int *original, int *sortedArr, int n) {
-    int *seqSort = new int[n];
+// Check the parallel result against std::sort of the encoded keys, independent of the radix kernels
+template <typename T>
+int correctnessCheck(T *original, T *sortedArr, int n) {
+    typedef typename RadixKey<T>::Bits Bits;
+    Bits *bits = new Bits[n];
+    for (int i = 0; i < n; i++) {
+        bits[i] = RadixKey<T>::encode(original[i]);
+    }
+
+    std::sort(bits, bits + n);
+
+    T *seqSort = new T[n];
     for (int i = 0; i < n; i++) {
-        seqSort[i] = original[i];
+        seqSort[i] = RadixKey<T>::decode(bits[i]);
     }
 
-    sequentialRadix(seqSort, n);
     int returnVal = compareArrays(seqSort, sortedArr, n);
+    delete[] bits;
     delete[] seqSort;
 
     return returnVal;
 }
 
-int main(int argc, char *argv[]) {
-    CALI_CXX_MARK_FUNCTION;
-    int pow;
-    int array_size;
-    char array_type;
-    std::string input_type;
+// MSD partition: a global histogram of the top MSD_BITS of (key - minVal), with crowded buckets split on
+// further bits, assigns each rank a contiguous range of buckets holding about N/P keys. One MPI_Alltoallv
+// moves every key straight to that rank, and the remaining digits are sorted with local passes only.
+// Replaces subinput and localSize with this rank's share, which is globally ordered by rank but may
+// differ in size from N/P by up to one bucket
+template <typename Bits>
+void msdPartition(Bits *&subinput, int &localSize, Bits minVal, Bits maxVal, int totalSize, int digitBits, MPI_Datatype bits_type, int world_size) {
+    // Offsetting by the global minimum spreads the keys over all top digit buckets wherever zero
+    // falls in the encoding, the offset is added back after the local sort
+    Bits keySpan = (minVal <= maxVal) ? (Bits) (maxVal - minVal) : 0;
+    int msdBits = std::min(bitWidth(keySpan), MSD_BITS);
+    int msdShift = bitWidth(keySpan) - msdBits;
+    int msdBuckets = 1 << msdBits;
+
+    int *count = new int[msdBuckets]();
+    int *globalCount = new int[msdBuckets];
+    int *sendCounts = new int[world_size]();
+    int *sendDispls = new int[world_size];
+    int *recvCounts = new int[world_size];
+    int *recvDispls = new int[world_size];
+
+    RADIX_MARK_BEGIN(comp);
+    RADIX_MARK_BEGIN(comp_small);
+
+    for (int i = 0; i < localSize; i++) {
+        subinput[i] -= minVal;
+    }
+    int *threadCounts = useThreads(localSize) ? new int[radixThreads * msdBuckets] : NULL;
+    countDigits(subinput, count, localSize, msdShift, msdBits, threadCounts);
 
-    if (argc == 3) {
-        pow = atoi(argv[1]);
-        array_size = 1 << pow; // 2^pow
-        array_type = argv[2][0];
+    RADIX_MARK_END(comp_small);
+    RADIX_MARK_END(comp);
+
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_small);
+
+    MPI_Allreduce(count, globalCount, msdBuckets, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    RADIX_MARK_END(comm_small);
+    RADIX_MARK_END(comm);
+
+    RADIX_MARK_BEGIN(comp);
+    RADIX_MARK_BEGIN(comp_small);
+
+    // Buckets with over an eighth of a rank's share are split again on the next MSD_REFINE_BITS bits, so
+    // encodings that crowd keys into few top digits (floating point exponents) still divide evenly
+    int refineBits = std::min(msdShift, MSD_REFINE_BITS);
+    int refineShift = msdShift - refineBits;
+    long long heavyLimit = (long long) totalSize / (8 * world_size);
+    int *firstFine = new int[msdBuckets + 1];
+    int fineBuckets = 0;
+    for (int b = 0; b < msdBuckets; b++) {
+        firstFine[b] = fineBuckets;
+        fineBuckets += (refineBits > 0 && globalCount[b] > heavyLimit) ? (1 << refineBits) : 1;
     }
-    else {
-        printf("\n Please provide the power for the array size (ex. 16 for 2^16), the number of process, and type of array ('u' for random/unsorted, 's' for sorted, 'r' for reverse sorted, 'p' for 1%% perturbed) without quotation marks.\n");
-        return 0;
+    firstFine[msdBuckets] = fineBuckets;
+    bool refined = fineBuckets > msdBuckets;
+
+    // Fine bucket of an offset key, equal to its top digit when nothing was refined
+    auto fineBucket = [&](Bits key) {
+        int top = (int) (key >> msdShift);
+        int width = firstFine[top + 1] - firstFine[top];
+        return firstFine[top] + (width > 1 ? (int) ((key >> refineShift) & (Bits) (width - 1)) : 0);
+    };
+
+    int *fineCount = count;
+    int *globalFine = globalCount;
+    if (refined) {
+        fineCount = new int[fineBuckets]();
+        globalFine = new int[fineBuckets];
+        for (int i = 0; i < localSize; i++) {
+            fineCount[fineBucket(subinput[i])]++;
+        }
+
+        RADIX_MARK_END(comp_small);
+        RADIX_MARK_END(comp);
+
+        RADIX_MARK_BEGIN(comm);
+        RADIX_MARK_BEGIN(comm_small);
+
+        MPI_Allreduce(fineCount, globalFine, fineBuckets, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+        RADIX_MARK_END(comm_small);
+        RADIX_MARK_END(comm);
+
+        RADIX_MARK_BEGIN(comp);
+        RADIX_MARK_BEGIN(comp_small);
     }
 
-    // Create caliper ConfigManager object
-    cali::ConfigManager mgr;
-    mgr.start();
+    // A bucket goes to the rank whose N/P slice of the global order holds the bucket's midpoint.
+    // That is non-decreasing in the bucket, so ranks own contiguous bucket ranges in key order
+    int *fineDest = new int[fineBuckets];
+    long long bucketStart = 0;
+    for (int f = 0; f < fineBuckets; f++) {
+        int destProcess = (int) ((bucketStart + globalFine[f] / 2) * world_size / totalSize);
+        fineDest[f] = std::min(destProcess, world_size - 1);
+        sendCounts[fineDest[f]] += fineCount[f];
+        bucketStart += globalFine[f];
+    }
 
-    int world_rank, world_size;
+    // Group the keys by destination so each one gets a contiguous run
+    Bits *grouped = new Bits[localSize];
+    if (refined) {
+        int *nextSlot = new int[world_size];
+        for (int i = 0, sum = 0; i < world_size; i++) {
+            nextSlot[i] = sum;
+            sum += sendCounts[i];
+        }
+        for (int i = 0; i < localSize; i++) {
+            grouped[nextSlot[fineDest[fineBucket(subinput[i])]]++] = subinput[i];
+        }
+        delete[] nextSlot;
+        delete[] fineCount;
+        delete[] globalFine;
+    } else {
+        scatterByDigit(subinput, grouped, count, localSize, msdShift, msdBits, threadCounts);
+    }
+    delete[] subinput;
+    subinput = grouped;
+    delete[] firstFine;
+    delete[] fineDest;
+    delete[] threadCounts;
+
+    sendDispls[0] = 0;
+    for (int i = 1; i < world_size; i++) {
+        sendDispls[i] = sendDispls[i - 1] + sendCounts[i - 1];
+    }
 
-    // Names for use in caliper regions
-    const char* data_init_runtime = "data_init_runtime";
-    const char* comm = "comm";
-    const char* comm_small = "comm_small";
-    const char* comm_large = "comm_large";
-    const char* comp = "comp";
-    const char* comp_small = "comp_small";
-    const char* comp_large = "comp_large";
-    const char* correctness_check = "correctness_check";
+    RADIX_MARK_END(comp_small);
+    RADIX_MARK_END(comp);
 
-    // Initializing MPI
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD,&world_rank);
-    MPI_Comm_size(MPI_COMM_WORLD,&world_size);
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_small);
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    RADIX_MARK_END(comm_small);
+    RADIX_MARK_END(comm);
+
+    recvDispls[0] = 0;
+    for (int i = 1; i < world_size; i++) {
+        recvDispls[i] = recvDispls[i - 1] + recvCounts[i - 1];
+    }
+
+    int recvSize = recvDispls[world_size - 1] + recvCounts[world_size - 1];
+    Bits *received = new Bits[recvSize];
+
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_large);
+
+    // The only global exchange of the sort
+    MPI_Alltoallv(subinput, sendCounts, sendDispls, bits_type, received, recvCounts, recvDispls, bits_type, MPI_COMM_WORLD);
+
+    RADIX_MARK_END(comm_large);
+    RADIX_MARK_END(comm);
+
+    RADIX_MARK_BEGIN(comp);
+    RADIX_MARK_BEGIN(comp_large);
+
+    // Every key already sits on its final rank, finish with local passes only
+    radixSortBits(received, recvSize, digitBits);
+    for (int i = 0; i < recvSize; i++) {
+        received[i] += minVal;
+    }
+
+    RADIX_MARK_END(comp_large);
+    RADIX_MARK_END(comp);
+
+    delete[] subinput;
+    subinput = received;
+    localSize = recvSize;
+
+    delete[] count;
+    delete[] globalCount;
+    delete[] sendCounts;
+    delete[] sendDispls;
+    delete[] recvCounts;
+    delete[] recvDispls;
+}
+
+// Generates the input on the master, sorts it across all ranks and checks the result
+template <typename T>
+void parallelRadix(int pow, int array_size, char array_type, int digitBits, ExchangeMode exchangeMode, int world_rank, int world_size) {
+    typedef typename RadixKey<T>::Bits Bits;
+    MPI_Datatype bits_type = bitsType<Bits>();
+    std::string input_type;
 
     // Initialize variables for later use
-    int *originalArr;
-    int *adjustedArr;
-    int adjustedSize, maxVal, subinputSize, offset;
+    T *originalArr = NULL;
     int sizeLimit = 1000000; // FIXME: Change this to adjust largest numbers generated for array
     
     // ************************************
 
     if (world_rank == MASTER) {
-        originalArr = new int[array_size];
+        originalArr = new T[array_size];
 
-        printf("Power: %d\n", pow);
-        printf("Array Size: 2^%d , which is %d\n", pow, array_size);
+        if (array_size == (1 << pow)) {
+            printf("Power: %d\n", pow);
+            printf("Array Size: 2^%d , which is %d\n", pow, array_size);
+        } else {
+            printf("Array Size: %d\n", array_size);
+        }
 
-        CALI_MARK_BEGIN(data_init_runtime);
+        RADIX_MARK_BEGIN(data_init_runtime);
 
-        // Seed random number generator
+        // Seed random number generators
         srand(static_cast<unsigned int>(time(0)));
+        std::mt19937_64 gen(time(0));
 
         // Generate input array randomly
         if (array_type == 'u') {
             for (int i = 0; i < array_size; i++) {
-                originalArr[i] = rand() % sizeLimit;
+                originalArr[i] = randomKey<T>(gen, sizeLimit);
             }
 
             input_type = "Random";
@@ -177,11 +785,11 @@ int main(int argc, char *argv[]) {
             // }
 
             for (int i = 0; i < array_size; i++) {
-                originalArr[i] = rand() % sizeLimit;
+                originalArr[i] = randomKey<T>(gen, sizeLimit);
             }
 
             // Sorts in ascending order
-            sequentialRadix(originalArr, array_size);
+            sequentialRadix(originalArr, array_size, digitBits);
 
             input_type = "Sorted";
 
@@ -195,11 +803,11 @@ int main(int argc, char *argv[]) {
             // }
 
             for (int i = 0; i < array_size; i++) {
-                originalArr[i] = rand() % sizeLimit;
+                originalArr[i] = randomKey<T>(gen, sizeLimit);
             }
 
             // Sorts in ascending order (then need to reverse the array)
-            sequentialRadix(originalArr, array_size);
+            sequentialRadix(originalArr, array_size, digitBits);
             std::reverse(originalArr, originalArr + array_size);
 
             input_type = "ReverseSorted";
@@ -211,10 +819,10 @@ int main(int argc, char *argv[]) {
         else if (array_type == 'p') {
             // First create sorted array
             for (int i = 0; i < array_size; i++) {
-                originalArr[i] = rand() % sizeLimit;
+                originalArr[i] = randomKey<T>(gen, sizeLimit);
             }
 
-            sequentialRadix(originalArr, array_size);
+            sequentialRadix(originalArr, array_size, digitBits);
 
             // Then swap 1% of elements randomly
             for (int i = 0; i < ceil(array_size / 100.0); i++) {
@@ -230,185 +838,396 @@ int main(int argc, char *argv[]) {
         else {
             printf("Didn't correctly specify type of array, defaulting to random.\n");
             for (int i = 0; i < array_size; i++) {
-                originalArr[i] = rand() % sizeLimit;
+                originalArr[i] = randomKey<T>(gen, sizeLimit);
             }
 
             input_type = "Random";
         }
 
-        CALI_MARK_END(data_init_runtime);
+        RADIX_MARK_END(data_init_runtime);
 
+        printf("Key Type: %s\n", RadixKey<T>::name());
         printf("Started radix_sort for an array of size %d with %d processes.\n", array_size, world_size);
+    }
 
-        CALI_MARK_BEGIN(comp);
-        CALI_MARK_BEGIN(comp_small);
-
-        // Find number of extra zeroes needed for equal processor workloads
-        subinputSize = ceil(array_size / ((double) world_size));
-        offset = world_size * subinputSize - array_size;
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_small);
 
-        adjustedSize = subinputSize * world_size;
-        adjustedArr = new int[adjustedSize];
+    MPI_Bcast(&array_size, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
 
-        for (int i = 0; i < adjustedSize; i++) {
-            if (i < offset) {
-                adjustedArr[i] = 0;
-            } else {
-                adjustedArr[i] = originalArr[i - offset];
-            }
-        }
+    RADIX_MARK_END(comm_small);
+    RADIX_MARK_END(comm);
 
-        maxVal = findMax(originalArr, array_size);
+    // Make sure all processes sync up before continuing
+    MPI_Barrier(MPI_COMM_WORLD);
 
-        CALI_MARK_END(comp_small);
-        CALI_MARK_END(comp);
+    // Balanced partition of the global order: the first N % P ranks hold one extra key.
+    // Every rank computes the same table, so destinations need no extra communication
+    int *rankCounts = new int[world_size];
+    int *rankDispls = new int[world_size];
+    for (int i = 0; i < world_size; i++) {
+        rankCounts[i] = array_size / world_size + (i < array_size % world_size);
+        rankDispls[i] = (i == 0) ? 0 : rankDispls[i - 1] + rankCounts[i - 1];
     }
 
-    CALI_MARK_BEGIN(comm);
-    CALI_MARK_BEGIN(comm_small);
+    // Number of keys this rank holds, only changes in the MSD exchange
+    int localSize = rankCounts[world_rank];
 
-    MPI_Bcast(&maxVal, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-    MPI_Bcast(&array_size, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-    MPI_Bcast(&subinputSize, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-    MPI_Bcast(&adjustedSize, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+    // Allocate memory for local arrays for each processor
+    T *localKeys = new T[localSize];
+    Bits *subinput = new Bits[localSize];
 
-    CALI_MARK_END(comm_small);
-    CALI_MARK_END(comm);
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_small);
 
-    // Make sure all processes sync up before continuing
-    MPI_Barrier(MPI_COMM_WORLD);
+    // Scatter the original keys straight from the master's array, no padded copy
+    MPI_Scatterv(originalArr, rankCounts, rankDispls, keyType<T>(), localKeys, localSize, keyType<T>(), MASTER, MPI_COMM_WORLD);
 
-    // Allocate memory for local arrays for each processor
-    int *subinput = new int[subinputSize];
+    RADIX_MARK_END(comm_small);
+    RADIX_MARK_END(comm);
 
-    CALI_MARK_BEGIN(comm);
-    CALI_MARK_BEGIN(comm_small);
+    RADIX_MARK_BEGIN(comp);
+    RADIX_MARK_BEGIN(comp_small);
 
-    // Scatter the original array into sub-arrays for each processor
-    MPI_Scatter(adjustedArr, subinputSize, MPI_INTEGER, subinput, subinputSize, MPI_INTEGER, MASTER, MPI_COMM_WORLD);
+    for (int i = 0; i < localSize; i++) {
+        subinput[i] = RadixKey<T>::encode(localKeys[i]);
+    }
 
-    CALI_MARK_END(comm_small);
-    CALI_MARK_END(comm);
+    Bits localMin, localMax, minVal, maxVal;
+    findMinMax(subinput, localSize, localMin, localMax);
 
-    int allCounts[10 * world_size];
+    RADIX_MARK_END(comp_small);
+    RADIX_MARK_END(comp);
 
-    // New array for redistribution step
-    int *newSubinput = new int[subinputSize];
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_small);
 
-    int **sendBlocks = new int*[world_size];
-    int **recvBlocks = new int*[world_size];
+    MPI_Allreduce(&localMin, &minVal, 1, bits_type, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&localMax, &maxVal, 1, bits_type, MPI_MAX, MPI_COMM_WORLD);
 
-    for (int i = 0; i < world_size; i++) {
-        sendBlocks[i] = new int[subinputSize * 2];
-        recvBlocks[i] = new int[subinputSize * 2];
+    RADIX_MARK_END(comm_small);
+    RADIX_MARK_END(comm);
+
+    Bits keyRange = minVal ^ maxVal;
+
+    // Digit geometry shared by every pass
+    int buckets = 1 << digitBits;
+    int mask = buckets - 1;
+    int passes = numPasses(keyRange, digitBits);
+
+    if (world_rank == MASTER) {
+        printf("Exchange: %s\n", exchangeNames[exchangeMode]);
+        printf("Threads per process: %d\n", radixThreads);
+        printf("Digit width: %d bits (%d buckets), %d passes\n", digitBits, buckets, passes);
     }
 
-    // Counting sort for each digit
-    for (int exp = 1; maxVal / exp > 0; exp *= 10) {
-        CALI_MARK_BEGIN(comp);
-        CALI_MARK_BEGIN(comp_small);
+    bool usePairExchange = (exchangeMode == EXCHANGE_PAIRS);
+
+    // Per-pass digit bookkeeping, reset at the start of each pass
+    int *count = new int[buckets];
+
+    // Per-thread histograms kept from the count to the scatter of each pass
+    int *threadCounts = useThreads(localSize) ? new int[radixThreads * buckets] : NULL;
+
+    // New array for redistribution step, the MSD exchange allocates its own
+    Bits *newSubinput = (exchangeMode == EXCHANGE_MSD) ? NULL : new Bits[localSize];
+
+    // Buffers for the pairwise exchange, only allocated when that mode is selected
+    int *allCounts = NULL;
+    int *sumCounts = NULL;
+    int *prefixSum = NULL;
+    int *leftSum = NULL;
+    int *lsdSent = NULL;
+    Bits **sendBlocks = NULL;
+    Bits **recvBlocks = NULL;
+
+    // Buffers for the Alltoallv exchange
+    int *globalCount = NULL;
+    int *rankPrefix = NULL;
+    int *sendCounts = NULL;
+    int *sendDispls = NULL;
+    int *recvCounts = NULL;
+    int *recvDispls = NULL;
+
+    if (usePairExchange) {
+        allCounts = new int[buckets * world_size];
+        sumCounts = new int[buckets];
+        prefixSum = new int[buckets];
+        leftSum = new int[buckets];
+        lsdSent = new int[buckets];
+
+        sendBlocks = new Bits*[world_size];
+        recvBlocks = new Bits*[world_size];
 
-        // Initialize all values to -1
         for (int i = 0; i < world_size; i++) {
-            std::fill(sendBlocks[i], sendBlocks[i] + (subinputSize * 2), -1);
+            sendBlocks[i] = new Bits[localSize * 2];
+            recvBlocks[i] = new Bits[localSize * 2];
         }
+    } else {
+        globalCount = new int[buckets];
+        rankPrefix = new int[buckets];
+        sendCounts = new int[world_size];
+        sendDispls = new int[world_size];
+        recvCounts = new int[world_size];
+        recvDispls = new int[world_size];
+    }
 
-        CALI_MARK_END(comp_small);
-        CALI_MARK_END(comp);
-        
-        // Initialize arrays for future use
-        int count[10] = {0};
-        int sumCounts[10] = {0};
-        int prefixSum[10] = {0};
-        int leftSum[10] = {0};
+    // Passes skipped because every key shared the digit
+    int skippedPasses = 0;
+
+#ifndef RADIX_NO_ANNOTATIONS
+    // Bytes this rank packed for exchanges over all passes
+    long long routedBytes = 0;
+#endif
+
+    if (exchangeMode == EXCHANGE_MSD) {
+        msdPartition(subinput, localSize, minVal, maxVal, array_size, digitBits, bits_type, world_size);
+    }
+
+    // Counting sort for each digit, the MSD exchange has already sorted every rank locally
+    for (int pass = 0; exchangeMode != EXCHANGE_MSD && pass < passes; pass++) {
+        int shift = pass * digitBits;
+
+        RADIX_MARK_BEGIN(comp);
+        RADIX_MARK_BEGIN(comp_small);
+
+        // Local histogram of the current digit
+        std::fill(count, count + buckets, 0);
+        countDigits(subinput, count, localSize, shift, digitBits, threadCounts);
+
+        RADIX_MARK_END(comp_small);
+        RADIX_MARK_END(comp);
+
+        if (!usePairExchange) {
+            RADIX_MARK_BEGIN(comm);
+            RADIX_MARK_BEGIN(comm_small);
+
+            // Global total of each digit, and how many of each digit live on lower ranks
+            MPI_Allreduce(count, globalCount, buckets, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+            MPI_Exscan(count, rankPrefix, buckets, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+            RADIX_MARK_END(comm_small);
+            RADIX_MARK_END(comm);
+
+            // MPI_Exscan leaves the receive buffer undefined on rank 0
+            if (world_rank == 0) {
+                std::fill(rankPrefix, rankPrefix + buckets, 0);
+            }
+        } else {
+            RADIX_MARK_BEGIN(comm);
+            RADIX_MARK_BEGIN(comm_small);
+
+            // Bring in all count arrays and gather them in allCounts
+            MPI_Allgather(count, buckets, MPI_INTEGER, allCounts, buckets, MPI_INTEGER, MPI_COMM_WORLD);
+
+            RADIX_MARK_END(comm_small);
+            RADIX_MARK_END(comm);
+
+            RADIX_MARK_BEGIN(comp);
+            RADIX_MARK_BEGIN(comp_small);
+
+            // Initialize arrays for future use
+            std::fill(sumCounts, sumCounts + buckets, 0);
+            std::fill(prefixSum, prefixSum + buckets, 0);
+            std::fill(leftSum, leftSum + buckets, 0);
+            std::fill(lsdSent, lsdSent + buckets, 0);
+
+            // Add up all values into sumCounts array
+            for (int i = 0; i < (buckets * world_size); i++) {
+                int lsd = i % buckets;
+                int p = i / buckets;
+                int val = allCounts[i];
+
+                // Store values left of current processor in leftSum
+                if (p < world_rank) {
+                    leftSum[lsd] += val;
+                }
+
+                sumCounts[lsd] += val;
+                prefixSum[lsd] += val;
+            }
+
+            // Create a sum array
+            for (int i = 1; i < buckets; i++) {
+                prefixSum[i] += prefixSum[i - 1];
+            }
+
+            RADIX_MARK_END(comp_small);
+            RADIX_MARK_END(comp);
+        }
+
+        // If one digit holds all keys the pass would leave every key in place, so skip the scatter and the exchange
+        if (uniformDigit(usePairExchange ? sumCounts : globalCount, buckets, array_size)) {
+            skippedPasses++;
+            continue;
+        }
+
+        RADIX_MARK_BEGIN(comp);
+        RADIX_MARK_BEGIN(comp_small);
 
-        CALI_MARK_BEGIN(comp);
-        CALI_MARK_BEGIN(comp_small);
+#ifndef RADIX_NO_ANNOTATIONS
+        long long loopStart = readTicks();
+#endif
 
-        countingSort(subinput, count, subinputSize, exp);
+        // Local stable sort by the current digit, leaves subinput in digit-ordered runs
+        scatterByDigit(subinput, newSubinput, count, localSize, shift, digitBits, threadCounts);
+        std::swap(subinput, newSubinput);
 
-        CALI_MARK_END(comp_small);
-        CALI_MARK_END(comp);
+        RADIX_MARK_END(comp_small);
+        RADIX_MARK_END(comp);
 
-        CALI_MARK_BEGIN(comm);
-        CALI_MARK_BEGIN(comm_small);
+        if (!usePairExchange) {
+            RADIX_MARK_BEGIN(comp);
+            RADIX_MARK_BEGIN(comp_small);
 
-        // Bring in all count arrays and gather them in allCounts
-        MPI_Allgather(count, 10, MPI_INTEGER, allCounts, 10, MPI_INTEGER, MPI_COMM_WORLD);
+            // The run of digit d starts at global index (keys with a smaller digit) + (digit d keys on lower ranks).
+            // Runs are laid out in increasing global order, so each destination gets one contiguous slice of subinput
+            // and the destination rank only ever moves forward
+            std::fill(sendCounts, sendCounts + world_size, 0);
+            int digitStart = 0;
+            int destProcess = 0;
+            for (int d = 0; d < buckets; d++) {
+                int destIndex = digitStart + rankPrefix[d];
+                int remaining = count[d];
 
-        CALI_MARK_END(comm_small);
-        CALI_MARK_END(comm);
+                while (remaining > 0) {
+                    while (destIndex >= rankDispls[destProcess] + rankCounts[destProcess]) {
+                        destProcess++;
+                    }
 
-        CALI_MARK_BEGIN(comp);
-        CALI_MARK_BEGIN(comp_small);
+                    int chunk = std::min(remaining, rankDispls[destProcess] + rankCounts[destProcess] - destIndex);
 
-        // Add up all values into sumCounts array
-        for (int i = 0; i < (10 * world_size); i++) {
-            int lsd = i % 10;
-            int p = i / 10;
-            int val = allCounts[i];
+                    sendCounts[destProcess] += chunk;
+                    destIndex += chunk;
+                    remaining -= chunk;
+                }
 
-            // Store values left of current processor in leftSum
-            if (p < world_rank) {
-                leftSum[lsd] += val;
+                digitStart += globalCount[d];
             }
 
-            sumCounts[lsd] += val;
-            prefixSum[lsd] += val;
+            sendDispls[0] = 0;
+            for (int i = 1; i < world_size; i++) {
+                sendDispls[i] = sendDispls[i - 1] + sendCounts[i - 1];
+            }
+
+            // Only the values travel
+#ifndef RADIX_NO_ANNOTATIONS
+            PassStats stats = {pass, localSize, localSize * (long long) sizeof(Bits), readTicks() - loopStart};
+            publishPassStats(stats);
+            routedBytes += stats.bytes;
+#endif
+
+            RADIX_MARK_END(comp_small);
+            RADIX_MARK_END(comp);
+
+            RADIX_MARK_BEGIN(comm);
+            RADIX_MARK_BEGIN(comm_small);
+
+            MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+            RADIX_MARK_END(comm_small);
+            RADIX_MARK_END(comm);
+
+            recvDispls[0] = 0;
+            for (int i = 1; i < world_size; i++) {
+                recvDispls[i] = recvDispls[i - 1] + recvCounts[i - 1];
+            }
+
+            RADIX_MARK_BEGIN(comm);
+            RADIX_MARK_BEGIN(comm_large);
+
+            // Ship only the values, one contiguous digit-ordered run per destination
+            MPI_Alltoallv(subinput, sendCounts, sendDispls, bits_type, newSubinput, recvCounts, recvDispls, bits_type, MPI_COMM_WORLD);
+
+            RADIX_MARK_END(comm_large);
+            RADIX_MARK_END(comm);
+
+            RADIX_MARK_BEGIN(comp);
+            RADIX_MARK_BEGIN(comp_small);
+
+            // Received runs arrive in sender order and each is digit-ordered, so a stable
+            // sort on the same digit restores the global order for this slice
+            std::fill(count, count + buckets, 0);
+            countingSort(newSubinput, subinput, count, localSize, shift, digitBits);
+
+            RADIX_MARK_END(comp_small);
+            RADIX_MARK_END(comp);
+
+            continue;
         }
 
-        // Create a sum array
-        for (int i = 1; i < 10; i++) {
-            prefixSum[i] += prefixSum[i - 1];
+        RADIX_MARK_BEGIN(comp);
+        RADIX_MARK_BEGIN(comp_small);
+
+        // Initialize all values to -1
+        for (int i = 0; i < world_size; i++) {
+            std::fill(sendBlocks[i], sendBlocks[i] + (localSize * 2), -1);
         }
 
         MPI_Request request;
         MPI_Status status;
-        int lsdSent[10] = {0};
 
         // Initializing for later use
-        int val, lsd, destIndex, destProcess, localDestIndex;
+        Bits val;
+        int lsd, destIndex, localDestIndex;
+
+        // Keys are digit-ordered, so their global indices and destination ranks only increase
+        int destProcess = 0;
         
         // FIXME: Main issue, changing from regular array to dynamic array based on input size
         // int blockSent[1024] = {0};
         int* blockSent = new int[world_size]();
 
-        CALI_MARK_END(comp_small);
-        CALI_MARK_END(comp);
+        RADIX_MARK_END(comp_small);
+        RADIX_MARK_END(comp);
 
-        // Use MPI calls to send and receive information from processes
-        for (int i = 0; i < subinputSize; i++) {
-            CALI_MARK_BEGIN(comp);
-            CALI_MARK_BEGIN(comp_large);
+        RADIX_MARK_BEGIN(comp);
+        RADIX_MARK_BEGIN(comp_large);
+
+#ifndef RADIX_NO_ANNOTATIONS
+        loopStart = readTicks();
+#endif
 
+        // Use MPI calls to send and receive information from processes
+        for (int i = 0; i < localSize; i++) {
             val = subinput[i];
-            lsd = (subinput[i] / exp) % 10;
+            lsd = getDigit(subinput[i], shift, mask);
 
             // Find the index for the value
             destIndex = prefixSum[lsd] - sumCounts[lsd] + leftSum[lsd] + lsdSent[lsd];
 
             // Increment the count for elements with lsd and set the value plus index
             lsdSent[lsd]++;
-            destProcess = destIndex / subinputSize;
-            localDestIndex = destIndex % subinputSize;
+            while (destIndex >= rankDispls[destProcess] + rankCounts[destProcess]) {
+                destProcess++;
+            }
+
+            localDestIndex = destIndex - rankDispls[destProcess];
 
             // Sets the values and local index in destination process
             sendBlocks[destProcess][blockSent[destProcess] * 2] = val;
             sendBlocks[destProcess][blockSent[destProcess] * 2 + 1] = localDestIndex;
             blockSent[destProcess]++;
-
-            CALI_MARK_END(comp_large);
-            CALI_MARK_END(comp);
         }
 
+        // Every key travels with its destination index
+#ifndef RADIX_NO_ANNOTATIONS
+        PassStats stats = {pass, localSize, 2LL * localSize * (long long) sizeof(Bits), readTicks() - loopStart};
+        publishPassStats(stats);
+        routedBytes += stats.bytes;
+#endif
+
+        RADIX_MARK_END(comp_large);
+        RADIX_MARK_END(comp);
+
         // FIXME: Main issue, changing from regular array to dynamic array based on input size
         // int blockReceive[1024] = {0};
         int* blockReceive = new int[world_size]();
 
-        for (int i = 0; i < world_size; i++) {
-            CALI_MARK_BEGIN(comm);
-            CALI_MARK_BEGIN(comm_large);
+        RADIX_MARK_BEGIN(comm);
+        RADIX_MARK_BEGIN(comm_large);
 
+        for (int i = 0; i < world_size; i++) {
             MPI_Isend(&blockSent[i], 1, MPI_INT, i, 0, MPI_COMM_WORLD, &request);
 
             // Store the size in a buffer and then write it to blockReceive for the origin processor
@@ -416,29 +1235,23 @@ int main(int argc, char *argv[]) {
             MPI_Recv(&buffer, 1, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
 
             blockReceive[status.MPI_SOURCE] = buffer;
-
-            CALI_MARK_END(comm_large);
-            CALI_MARK_END(comm);
         }
 
         MPI_Barrier(MPI_COMM_WORLD);
 
         // Send + receive blocks of a specific size
         for (int i = 0; i < world_size; i++) {
-            CALI_MARK_BEGIN(comm);
-            CALI_MARK_BEGIN(comm_large);
-
-            MPI_Isend(sendBlocks[i], blockSent[i] * 2, MPI_INT, i, 0, MPI_COMM_WORLD, &request);
-            MPI_Recv(recvBlocks[i], blockReceive[i] * 2, MPI_INT, i, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-
-            CALI_MARK_END(comm_large);
-            CALI_MARK_END(comm);
+            MPI_Isend(sendBlocks[i], blockSent[i] * 2, bits_type, i, 0, MPI_COMM_WORLD, &request);
+            MPI_Recv(recvBlocks[i], blockReceive[i] * 2, bits_type, i, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
         }
 
         MPI_Barrier(MPI_COMM_WORLD);
 
-        CALI_MARK_BEGIN(comp);
-        CALI_MARK_BEGIN(comp_small);
+        RADIX_MARK_END(comm_large);
+        RADIX_MARK_END(comm);
+
+        RADIX_MARK_BEGIN(comp);
+        RADIX_MARK_BEGIN(comp_small);
 
         // Build a new sub-array from these sent blocks
         for (int sender = 0; sender < world_size; sender++) {
@@ -449,40 +1262,80 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        for (int i = 0; i < subinputSize; i++) {
-          subinput[i] = newSubinput[i];
-        }
+        std::swap(subinput, newSubinput);
 
-        CALI_MARK_END(comp_small);
-        CALI_MARK_END(comp);
+        RADIX_MARK_END(comp_small);
+        RADIX_MARK_END(comp);
 
         // Deallocate memory from this iteration here
         delete[] blockSent;
         delete[] blockReceive;
     }
 
+    // Global key exchanges actually performed, MSD moves every key once and skipped passes move none
+    int globalExchanges = (exchangeMode == EXCHANGE_MSD) ? 1 : passes - skippedPasses;
+
+    if (world_rank == MASTER) {
+        if (exchangeMode != EXCHANGE_MSD) {
+            printf("Skipped %d of %d passes with a uniform digit\n", skippedPasses, passes);
+        }
+        printf("Global exchanges: %d\n", globalExchanges);
+    }
+
     // Final sorted array sent to root process
-    int *finalArr;
+    T *finalArr = NULL;
+    int *finalCounts = NULL;
+    int *finalDispls = NULL;
     if (world_rank == MASTER) {
-        finalArr = new int[adjustedSize];
+        finalArr = new T[array_size];
+        finalCounts = new int[world_size];
+        finalDispls = new int[world_size];
     }
 
-    CALI_MARK_BEGIN(comm);
-    CALI_MARK_BEGIN(comm_small);
+    // Decode locally so the master receives finished keys, reusing the scatter buffer when it fits
+    if (localSize > rankCounts[world_rank]) {
+        delete[] localKeys;
+        localKeys = new T[localSize];
+    }
 
-    // Send all of the sub-arrays into the final array
-    MPI_Gather(subinput, subinputSize, MPI_INTEGER, &finalArr[world_rank * subinputSize], subinputSize, MPI_INTEGER, MASTER, MPI_COMM_WORLD);
+    RADIX_MARK_BEGIN(comp);
+    RADIX_MARK_BEGIN(comp_small);
 
-    CALI_MARK_END(comm_small);
-    CALI_MARK_END(comm);
+    for (int i = 0; i < localSize; i++) {
+        localKeys[i] = RadixKey<T>::decode(subinput[i]);
+    }
+
+    RADIX_MARK_END(comp_small);
+    RADIX_MARK_END(comp);
+
+    RADIX_MARK_BEGIN(comm);
+    RADIX_MARK_BEGIN(comm_small);
+
+    // Ranks can hold different numbers of keys after the MSD exchange
+    MPI_Gather(&localSize, 1, MPI_INT, finalCounts, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
 
     if (world_rank == MASTER) {
-        // Add offset to ignore the added zeroes used to level each processors subarrays
-        finalArr += offset;
+        finalDispls[0] = 0;
+        for (int i = 1; i < world_size; i++) {
+            finalDispls[i] = finalDispls[i - 1] + finalCounts[i - 1];
+        }
+    }
 
-        CALI_MARK_BEGIN(correctness_check);
+    // Send all of the sub-arrays into the final array
+    MPI_Gatherv(localKeys, localSize, keyType<T>(), finalArr, finalCounts, finalDispls, keyType<T>(), MASTER, MPI_COMM_WORLD);
+
+    RADIX_MARK_END(comm_small);
+    RADIX_MARK_END(comm);
+
+    if (world_rank == MASTER && exchangeMode == EXCHANGE_MSD) {
+        int largest = *std::max_element(finalCounts, finalCounts + world_size);
+        printf("MSD exchange: largest rank holds %d keys (%.2fx the even share)\n", largest, largest * (double) world_size / array_size);
+    }
+
+    if (world_rank == MASTER) {
+        RADIX_MARK_BEGIN(correctness_check);
         int result = correctnessCheck(originalArr, finalArr, array_size);
-        CALI_MARK_END(correctness_check);
+        RADIX_MARK_END(correctness_check);
 
         // FIXME: Used this part to check that the final array was sorted
         // ***********************************************************
@@ -507,23 +1360,41 @@ int main(int argc, char *argv[]) {
             printf("Not sorted properly.\n\n");
         }
 
-        // Make sure pointer goes back to original location for de-allocation
-        finalArr -= offset;
-
         delete[] originalArr;
-        delete[] adjustedArr;
         delete[] finalArr;
+        delete[] finalCounts;
+        delete[] finalDispls;
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
 
-    for (int i = 0; i < world_size; i++) {
-        delete[] sendBlocks[i];
-        delete[] recvBlocks[i];
+    if (usePairExchange) {
+        for (int i = 0; i < world_size; i++) {
+            delete[] sendBlocks[i];
+            delete[] recvBlocks[i];
+        }
+
+        delete[] sendBlocks;
+        delete[] recvBlocks;
+        delete[] allCounts;
+        delete[] sumCounts;
+        delete[] prefixSum;
+        delete[] leftSum;
+        delete[] lsdSent;
+    } else {
+        delete[] globalCount;
+        delete[] rankPrefix;
+        delete[] sendCounts;
+        delete[] sendDispls;
+        delete[] recvCounts;
+        delete[] recvDispls;
     }
-    
-    delete[] sendBlocks;
-    delete[] recvBlocks;
+
+    delete[] count;
+    delete[] threadCounts;
+    delete[] rankCounts;
+    delete[] rankDispls;
+    delete[] localKeys;
     delete[] subinput;
     delete[] newSubinput;
 
@@ -534,15 +1405,152 @@ int main(int argc, char *argv[]) {
     adiak::clustername();   // Name of the cluster
     adiak::value("algorithm", "radix"); // The name of the algorithm you are using (e.g., "merge", "bitonic")
     adiak::value("programming_model", "mpi"); // e.g. "mpi"
-    adiak::value("data_type", "int"); // The datatype of input elements (e.g., double, int, float)
-    adiak::value("size_of_data_type", "4 bytes"); // sizeof(datatype) of input elements in bytes (e.g., 1, 2, 4)
+    adiak::value("data_type", RadixKey<T>::name()); // The datatype of input elements (e.g., double, int, float)
+    adiak::value("size_of_data_type", sizeof(T)); // sizeof(datatype) of input elements in bytes (e.g., 1, 2, 4)
     adiak::value("input_size", array_size); // The number of elements in input dataset (1000)
     adiak::value("input_type", input_type); // For sorting, this would be choices: ("Sorted", "ReverseSorted", "Random", "1_perc_perturbed")
+    adiak::value("digit_bits", digitBits); // Width of one radix digit in bits
+    adiak::value("radix_passes", passes); // Number of digit passes the key range needs
+    adiak::value("radix_exchanges", globalExchanges); // Number of global key exchanges performed
+    adiak::value("radix_exchange", exchangeNames[exchangeMode]); // Redistribution scheme between ranks
+    adiak::value("radix_skipped_passes", skippedPasses); // Passes skipped because every key shared the digit
+#ifndef RADIX_NO_ANNOTATIONS
+    adiak::value("radix_routed_bytes", routedBytes); // Bytes this rank packed for LSD exchanges over all passes
+#endif
     adiak::value("num_procs", world_size); // The number of processors (MPI ranks)
+    adiak::value("num_threads", radixThreads); // Threads per MPI rank in the local counting sort
     adiak::value("scalability", "strong"); // The scalability of your algorithm. choices: ("strong", "weak")
     adiak::value("group_num", "4"); // The number of your group (integer, e.g., 1, 10)
     adiak::value("implementation_source", "online"); // Where you got the source code of your algorithm. choices: ("online", "ai", "handwritten")
 
+}
+
+int main(int argc, char *argv[]) {
+    RADIX_MARK_FUNCTION;
+    int pow;
+    int array_size;
+    char array_type;
+
+    int digitBits = DEFAULT_DIGIT_BITS;
+    ExchangeMode exchangeMode = EXCHANGE_ALLTOALLV;
+    const char *keyType = "int32";
+
+    if (argc >= 3) {
+        pow = atoi(argv[1]);
+        array_size = 1 << pow; // 2^pow
+        array_type = argv[2][0];
+
+        // Optional exact key count, e.g. size=1000003 for an N that does not divide evenly over the ranks
+        const char *sizeOption = findOption(argc, argv, "size");
+        if (sizeOption != NULL) {
+            array_size = atoi(sizeOption);
+        }
+
+        if (array_size < 1) {
+            printf("\n Array size must be at least 1.\n");
+            return 0;
+        }
+
+        // Optional digit width, e.g. bits=11 for 2048 buckets per pass
+        const char *bitsOption = findOption(argc, argv, "bits");
+        if (bitsOption != NULL) {
+            digitBits = atoi(bitsOption);
+        }
+
+        if (digitBits < 1 || digitBits > MAX_DIGIT_BITS) {
+            printf("\n Digit width must be between 1 and %d bits.\n", MAX_DIGIT_BITS);
+            return 0;
+        }
+
+        // Optional redistribution scheme: "alltoallv" (default), the original (value, index) "pairs" messaging,
+        // or "msd" for a single MSD partition exchange followed by local passes
+        const char *exchangeOption = findOption(argc, argv, "exchange");
+        if (exchangeOption != NULL) {
+            if (strcmp(exchangeOption, "pairs") == 0) {
+                exchangeMode = EXCHANGE_PAIRS;
+            } else if (strcmp(exchangeOption, "msd") == 0) {
+                exchangeMode = EXCHANGE_MSD;
+            } else if (strcmp(exchangeOption, "alltoallv") != 0) {
+                printf("\n Unknown exchange '%s', expected 'alltoallv', 'pairs' or 'msd'.\n", exchangeOption);
+                return 0;
+            }
+        }
+
+        // Optional key type: int32 (default), int64, uint64, float or double
+        const char *keyOption = findOption(argc, argv, "key");
+        if (keyOption != NULL) {
+            keyType = keyOption;
+        }
+
+        if (strcmp(keyType, "int32") != 0 && strcmp(keyType, "int64") != 0 && strcmp(keyType, "uint64") != 0 &&
+            strcmp(keyType, "float") != 0 && strcmp(keyType, "double") != 0) {
+            printf("\n Unknown key type '%s', expected int32, int64, uint64, float or double.\n", keyType);
+            return 0;
+        }
+
+        // Optional threads per rank for the local counting sort, e.g. one rank per socket with threads=24
+        const char *threadsOption = findOption(argc, argv, "threads");
+        if (threadsOption != NULL) {
+            radixThreads = atoi(threadsOption);
+        }
+
+        if (radixThreads < 1) {
+            printf("\n Thread count must be at least 1.\n");
+            return 0;
+        }
+
+#ifndef _OPENMP
+        if (radixThreads > 1) {
+            printf("\n Built without OpenMP, running with 1 thread per rank.\n");
+            radixThreads = 1;
+        }
+#endif
+    }
+    else {
+        printf("\n Please provide the power for the array size (ex. 16 for 2^16), the number of process, and type of array ('u' for random/unsorted, 's' for sorted, 'r' for reverse sorted, 'p' for 1%% perturbed) without quotation marks.\n");
+        printf(" Optionally add size=<n> to sort exactly n keys instead of 2^power.\n");
+        printf(" Optionally add bits=<n> to set the radix digit width (default %d, ex. bits=11 for 2048 buckets).\n", DEFAULT_DIGIT_BITS);
+        printf(" Optionally add exchange=pairs to use the original (value, index) messaging instead of MPI_Alltoallv,\n");
+        printf(" or exchange=msd to move every key to its final rank once and finish with local passes.\n");
+        printf(" Optionally add key=<type> to sort int32 (default), int64, uint64, float or double keys.\n");
+        printf(" Optionally add threads=<n> to run the local counting sort on n threads per process.\n");
+        return 0;
+    }
+
+    // Create caliper ConfigManager object
+    cali::ConfigManager mgr;
+    mgr.start();
+
+    int world_rank, world_size;
+
+    // Initializing MPI
+    // Only the main thread makes MPI calls, worker threads just sort locally
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD,&world_rank);
+    MPI_Comm_size(MPI_COMM_WORLD,&world_size);
+
+    if (provided < MPI_THREAD_FUNNELED && radixThreads > 1) {
+        if (world_rank == MASTER) {
+            printf("\n MPI library does not support MPI_THREAD_FUNNELED, running with 1 thread per rank.\n");
+        }
+        radixThreads = 1;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if (strcmp(keyType, "int32") == 0) {
+        parallelRadix<int32_t>(pow, array_size, array_type, digitBits, exchangeMode, world_rank, world_size);
+    } else if (strcmp(keyType, "int64") == 0) {
+        parallelRadix<int64_t>(pow, array_size, array_type, digitBits, exchangeMode, world_rank, world_size);
+    } else if (strcmp(keyType, "uint64") == 0) {
+        parallelRadix<uint64_t>(pow, array_size, array_type, digitBits, exchangeMode, world_rank, world_size);
+    } else if (strcmp(keyType, "float") == 0) {
+        parallelRadix<float>(pow, array_size, array_type, digitBits, exchangeMode, world_rank, world_size);
+    } else {
+        parallelRadix<double>(pow, array_size, array_type, digitBits, exchangeMode, world_rank, world_size);
+    }
+
     // Flush Caliper output before finalizing MPI
     mgr.stop();
     mgr.flush();
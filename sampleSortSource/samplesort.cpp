@@ -6,6 +6,8 @@
 #include <ctime>     // for time
 #include <cassert>   // for assert (optional)
 #include <cmath>     // for pow
+#include <climits>   // for INT_MIN, INT_MAX
+#include <cstring>   // for strncmp, strlen
 
 #include <caliper/cali.h>
 #include <caliper/cali-manager.h>
@@ -28,17 +30,17 @@ void data_init_runtime(std::vector<int>& local_data, int size, int rank, int glo
             local_data.push_back(rand() % max_value);  // Random numbers between 0 and max_value
         }
     }else if(sorted){
-        int added = rank * array_size;
+        int added = rank * size;
         for (int i = 0; i < size; ++i) {
             local_data.push_back(i + added);
         }
     }else if(reverse){
-        int added = rank * array_size;
+        int added = rank * size;
         for (int i = size - 1; i >= 0; --i) {
             local_data.push_back(i + added);
         }
     }else if(perturbed){
-        int added = rank * array_size;
+        int added = rank * size;
         for (int i = 0; i < size; ++i) {
             local_data.push_back(i + added);
         }
@@ -65,6 +67,307 @@ std::vector<int> choose_splitters(const std::vector<int>& sorted_samples, int nu
     return splitters;
 }
 
+// Look for an optional "name=value" argument after the exponent, returns NULL if missing
+const char* find_option(int argc, char* argv[], const char* name) {
+    size_t len = strlen(name);
+    for (int i = 2; i < argc; ++i) {
+        if (strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+            return argv[i] + len + 1;
+        }
+    }
+    return NULL;
+}
+
+// Refine the splitters with global histograms until every bucket is within tolerance * N/P of N/P,
+// ties broken by (key, rank, index). Returns the local end of each bucket but the last
+std::vector<int> balance_splitters(const std::vector<int>& local_data, const std::vector<int>& splitters, double tolerance) {
+    int num_splitters = splitters.size();
+    int num_buckets = num_splitters + 1;
+
+    long long local_count = local_data.size();
+    long long global_count = 0;
+    MPI_Allreduce(&local_count, &global_count, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    // A bucket lies between two cuts, so each cut gets half the tolerance
+    long long slack = (long long) (tolerance * global_count / num_buckets / 2);
+
+    // Search bracket per splitter, the first probe is the regular sample splitter
+    std::vector<long long> lo(num_splitters, INT_MIN), hi(num_splitters, INT_MAX);
+    std::vector<long long> probe(splitters.begin(), splitters.end());
+    std::vector<int> cut_key(num_splitters);
+    std::vector<long long> cut_pos(num_splitters), keys_below(num_splitters);
+    std::vector<bool> resolved(num_splitters, false);
+    int unresolved = num_splitters;
+
+    std::vector<long long> local_hist(2 * num_splitters), global_hist(2 * num_splitters);
+    while (unresolved > 0) {
+        for (int i = 0; i < num_splitters; ++i) {
+            int key = (int) probe[i];
+            local_hist[2 * i] = std::lower_bound(local_data.begin(), local_data.end(), key) - local_data.begin();
+            local_hist[2 * i + 1] = std::upper_bound(local_data.begin(), local_data.end(), key) - local_data.begin();
+        }
+        MPI_Allreduce(local_hist.data(), global_hist.data(), 2 * num_splitters, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+        for (int i = 0; i < num_splitters; ++i) {
+            if (resolved[i]) {
+                continue;
+            }
+            // Cutting at the probe can place bucket i's end anywhere in [below, up_to]
+            long long target = (i + 1) * global_count / num_buckets;
+            long long below = global_hist[2 * i];
+            long long up_to = global_hist[2 * i + 1];
+            long long pos = std::max(below, std::min(target, up_to));
+            if (std::llabs(pos - target) <= slack || lo[i] >= hi[i]) {
+                cut_key[i] = (int) probe[i];
+                cut_pos[i] = pos;
+                keys_below[i] = below;
+                resolved[i] = true;
+                --unresolved;
+                continue;
+            }
+
+            // Narrow towards the smallest key with at least target keys up to it
+            if (up_to >= target) {
+                hi[i] = probe[i];
+            } else {
+                lo[i] = probe[i] + 1;
+            }
+            probe[i] = lo[i] + (hi[i] - lo[i]) / 2;
+        }
+    }
+
+    // Hand out the copies of each splitter key in rank order, lower ranks take theirs first
+    std::vector<int> local_below(num_splitters), local_equal(num_splitters), equal_before(num_splitters, 0);
+    for (int i = 0; i < num_splitters; ++i) {
+        auto range = std::equal_range(local_data.begin(), local_data.end(), cut_key[i]);
+        local_below[i] = range.first - local_data.begin();
+        local_equal[i] = range.second - range.first;
+    }
+    MPI_Exscan(local_equal.data(), equal_before.data(), num_splitters, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    int taskid;
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    if (taskid == 0) {
+        std::fill(equal_before.begin(), equal_before.end(), 0);
+    }
+
+    std::vector<int> bucket_ends(num_splitters);
+    int previous_end = 0;
+    for (int i = 0; i < num_splitters; ++i) {
+        long long ties = cut_pos[i] - keys_below[i] - equal_before[i];
+        int take = (int) std::max(0LL, std::min(ties, (long long) local_equal[i]));
+        bucket_ends[i] = std::max(previous_end, local_below[i] + take);
+        previous_end = bucket_ends[i];
+    }
+    return bucket_ends;
+}
+
+// Merge the sorted runs data[bounds[i], bounds[i + 1]) into one sorted run. Each pass merges
+// neighbouring pairs of runs, so every key moves log2(runs) times instead of a full re-sort
+void merge_runs(std::vector<int>& data, std::vector<int> bounds) {
+    std::vector<int> buffer(data.size());
+    while (bounds.size() > 2) {
+        std::vector<int> merged_bounds;
+        size_t i = 0;
+        for (; i + 2 < bounds.size(); i += 2) {
+            std::merge(data.begin() + bounds[i], data.begin() + bounds[i + 1],
+                       data.begin() + bounds[i + 1], data.begin() + bounds[i + 2],
+                       buffer.begin() + bounds[i]);
+            merged_bounds.push_back(bounds[i]);
+        }
+        // An odd run out is carried over to the next pass unchanged
+        if (i + 1 < bounds.size()) {
+            std::copy(data.begin() + bounds[i], data.begin() + bounds[i + 1], buffer.begin() + bounds[i]);
+            merged_bounds.push_back(bounds[i]);
+        }
+        merged_bounds.push_back(bounds.back());
+        data.swap(buffer);
+        bounds.swap(merged_bounds);
+    }
+}
+
+// Node grouping used by the two-level exchange, built once outside the timed exchange
+struct NodeLayout {
+    MPI_Comm node_comm;
+    MPI_Comm leader_comm;  // MPI_COMM_NULL on ranks that are not node leaders
+    int node_rank;
+    int node_ranks;
+    int num_nodes;
+    bool leader;
+    std::vector<std::vector<int>> members;  // world ranks of every node, in node rank order
+};
+
+// Group ranks by node (MPI_COMM_TYPE_SHARED, or blocks of node_size ranks to emulate nodes)
+NodeLayout build_node_layout(int node_size) {
+    int taskid, numtasks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+
+    NodeLayout layout;
+    if (node_size > 0) {
+        MPI_Comm_split(MPI_COMM_WORLD, taskid / node_size, taskid, &layout.node_comm);
+    } else {
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, taskid, MPI_INFO_NULL, &layout.node_comm);
+    }
+    MPI_Comm_rank(layout.node_comm, &layout.node_rank);
+    MPI_Comm_size(layout.node_comm, &layout.node_ranks);
+    layout.leader = layout.node_rank == 0;
+    MPI_Comm_split(MPI_COMM_WORLD, layout.leader ? 0 : MPI_UNDEFINED, taskid, &layout.leader_comm);
+
+    // Number the nodes by their leader and list every node's members in node rank order
+    int node_id = 0;
+    layout.num_nodes = 0;
+    if (layout.leader) {
+        MPI_Comm_rank(layout.leader_comm, &node_id);
+        MPI_Comm_size(layout.leader_comm, &layout.num_nodes);
+    }
+    MPI_Bcast(&node_id, 1, MPI_INT, 0, layout.node_comm);
+    MPI_Bcast(&layout.num_nodes, 1, MPI_INT, 0, layout.node_comm);
+    std::vector<int> node_of(numtasks);
+    MPI_Allgather(&node_id, 1, MPI_INT, node_of.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    layout.members.resize(layout.num_nodes);
+    for (int w = 0; w < numtasks; ++w) {
+        layout.members[node_of[w]].push_back(w);
+    }
+    // members[] is in world rank order, put it in node rank order
+    std::vector<int> order_in_node(numtasks);
+    MPI_Allgather(&layout.node_rank, 1, MPI_INT, order_in_node.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int n = 0; n < layout.num_nodes; ++n) {
+        std::sort(layout.members[n].begin(), layout.members[n].end(),
+                  [&](int a, int b) { return order_in_node[a] < order_in_node[b]; });
+    }
+    return layout;
+}
+
+void free_node_layout(NodeLayout& layout) {
+    if (layout.leader_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&layout.leader_comm);
+    }
+    MPI_Comm_free(&layout.node_comm);
+}
+
+// Two-level bucket exchange: members gather at their node leader, leaders swap one message per node pair
+void node_aware_exchange(const NodeLayout& layout, const std::vector<int>& local_data, const std::vector<int>& send_sizes,
+                         const std::vector<int>& recv_sizes, std::vector<int>& recv_data) {
+    int numtasks;
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+    MPI_Comm node_comm = layout.node_comm;
+    MPI_Comm leader_comm = layout.leader_comm;
+    int node_ranks = layout.node_ranks;
+    int num_nodes = layout.num_nodes;
+    bool leader = layout.leader;
+    const std::vector<std::vector<int>>& members = layout.members;
+
+    // Pack this rank's buckets by destination node, skipped when the nodes are consecutive rank blocks
+    std::vector<int> bucket_starts(numtasks + 1, 0);
+    for (int w = 0; w < numtasks; ++w) {
+        bucket_starts[w + 1] = bucket_starts[w] + send_sizes[w];
+    }
+    bool in_node_order = true;
+    int expected = 0;
+    for (int n = 0; n < num_nodes; ++n) {
+        for (int w : members[n]) {
+            in_node_order = in_node_order && w == expected++;
+        }
+    }
+    std::vector<int> packed;
+    const int* node_major = local_data.data();
+    if (!in_node_order) {
+        packed.resize(local_data.size());
+        int k = 0;
+        for (int n = 0; n < num_nodes; ++n) {
+            for (int w : members[n]) {
+                std::copy(local_data.begin() + bucket_starts[w], local_data.begin() + bucket_starts[w + 1], packed.begin() + k);
+                k += send_sizes[w];
+            }
+        }
+        node_major = packed.data();
+    }
+    std::vector<int> segment_counts(num_nodes, 0), segment_starts(num_nodes, 0);
+    for (int n = 0, k = 0; n < num_nodes; ++n) {
+        segment_starts[n] = k;
+        for (int w : members[n]) {
+            segment_counts[n] += send_sizes[w];
+        }
+        k += segment_counts[n];
+    }
+
+    // The leader needs every member's segment counts and recv_sizes
+    std::vector<int> member_segments(leader ? node_ranks * num_nodes : 0);
+    std::vector<int> member_recv_sizes(leader ? node_ranks * numtasks : 0);
+    MPI_Gather(segment_counts.data(), num_nodes, MPI_INT, member_segments.data(), num_nodes, MPI_INT, 0, node_comm);
+    MPI_Gather(recv_sizes.data(), numtasks, MPI_INT, member_recv_sizes.data(), numtasks, MPI_INT, 0, node_comm);
+
+    // One gather per destination node lands the segments straight in the leader's send buffer
+    std::vector<int> node_send_counts(num_nodes, 0), node_send_displs(num_nodes, 0);
+    std::vector<int> gather_counts(leader ? node_ranks * num_nodes : 0);
+    std::vector<int> gather_displs(leader ? node_ranks * num_nodes : 0);
+    int node_keys = 0;
+    if (leader) {
+        for (int n = 0; n < num_nodes; ++n) {
+            node_send_displs[n] = node_keys;
+            for (int m = 0; m < node_ranks; ++m) {
+                gather_counts[n * node_ranks + m] = member_segments[m * num_nodes + n];
+                gather_displs[n * node_ranks + m] = node_keys;
+                node_keys += gather_counts[n * node_ranks + m];
+            }
+            node_send_counts[n] = node_keys - node_send_displs[n];
+        }
+    }
+    std::vector<int> node_buffer(node_keys);
+    std::vector<MPI_Request> gathers(num_nodes);
+    for (int n = 0; n < num_nodes; ++n) {
+        MPI_Igatherv(node_major + segment_starts[n], segment_counts[n], MPI_INT, node_buffer.data(),
+                     leader ? &gather_counts[n * node_ranks] : NULL, leader ? &gather_displs[n * node_ranks] : NULL,
+                     MPI_INT, 0, node_comm, &gathers[n]);
+    }
+    MPI_Waitall(num_nodes, gathers.data(), MPI_STATUSES_IGNORE);
+
+    std::vector<int> scatter_counts(node_ranks), scatter_displs(node_ranks + 1, 0);
+    if (leader) {
+        // Messages arrive as [source member][destination member], the members' recv_sizes give the layout
+        std::vector<int> node_recv_counts(num_nodes, 0), node_recv_displs(num_nodes, 0);
+        int incoming = 0;
+        for (int n = 0; n < num_nodes; ++n) {
+            node_recv_displs[n] = incoming;
+            for (int w : members[n]) {
+                for (int m = 0; m < node_ranks; ++m) {
+                    incoming += member_recv_sizes[m * numtasks + w];
+                }
+            }
+            node_recv_counts[n] = incoming - node_recv_displs[n];
+        }
+        std::vector<int> node_incoming(incoming);
+        MPI_Alltoallv(node_buffer.data(), node_send_counts.data(), node_send_displs.data(), MPI_INT,
+                      node_incoming.data(), node_recv_counts.data(), node_recv_displs.data(), MPI_INT, leader_comm);
+
+        // Reorder into the send buffer for the scatter: each member's keys by sender world rank
+        std::vector<int> recv_starts(node_ranks * numtasks);
+        for (int m = 0; m < node_ranks; ++m) {
+            int offset = scatter_displs[m];
+            for (int w = 0; w < numtasks; ++w) {
+                recv_starts[m * numtasks + w] = offset;
+                offset += member_recv_sizes[m * numtasks + w];
+            }
+            scatter_counts[m] = offset - scatter_displs[m];
+            scatter_displs[m + 1] = offset;
+        }
+        node_buffer.resize(incoming);
+        int read = 0;
+        for (int n = 0; n < num_nodes; ++n) {
+            for (int w : members[n]) {
+                for (int m = 0; m < node_ranks; ++m) {
+                    int count = member_recv_sizes[m * numtasks + w];
+                    std::copy(node_incoming.begin() + read, node_incoming.begin() + read + count,
+                              node_buffer.begin() + recv_starts[m * numtasks + w]);
+                    read += count;
+                }
+            }
+        }
+    }
+
+    MPI_Scatterv(node_buffer.data(), scatter_counts.data(), scatter_displs.data(), MPI_INT,
+                 recv_data.data(), recv_data.size(), MPI_INT, 0, node_comm);
+}
+
 // Sample Sort using MPI
 int main(int argc, char* argv[]) {
     // Initialize Caliper and MPI
@@ -113,9 +416,11 @@ int main(int argc, char* argv[]) {
     mgr.start();
 
     // Parse array size from command-line arguments
-    if (argc != 2) {
+    if (argc < 2) {
         if (taskid == MASTER) {
-            std::cerr << "Usage: " << argv[0] << " <array size exponent (e.g., 16 for 2^16)>\n";
+            std::cerr << "Usage: " << argv[0] << " <array size exponent (e.g., 16 for 2^16)> [splitters=regular|balanced] [tolerance=<fraction>] [exchange=flat|node] [node_size=<ranks>]\n";
+            std::cerr << "  splitters=balanced refines the sample splitters until every bucket holds N/P keys within tolerance * N/P (default 0.01)\n";
+            std::cerr << "  exchange=node routes the buckets through one leader per node, node_size=<ranks> groups ranks into emulated nodes\n";
         }
         MPI_Abort(MPI_COMM_WORLD, 1);
         return 1;
@@ -127,6 +432,49 @@ int main(int argc, char* argv[]) {
     int global_size = std::pow(2, exponent);  // Size is 2^exponent
     int local_size = global_size / numtasks;
 
+    // Splitter selection: "regular" uses the sample splitters as is, "balanced" refines them
+    std::string splitter_mode = "regular";
+    const char* splitter_option = find_option(argc, argv, "splitters");
+    if (splitter_option != NULL) {
+        splitter_mode = splitter_option;
+    }
+    if (splitter_mode != "regular" && splitter_mode != "balanced") {
+        if (taskid == MASTER) {
+            std::cerr << "Unknown splitters '" << splitter_mode << "', expected 'regular' or 'balanced'\n";
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+    double tolerance = 0.01;
+    const char* tolerance_option = find_option(argc, argv, "tolerance");
+    if (tolerance_option != NULL) {
+        tolerance = std::atof(tolerance_option);
+    }
+    // Beyond half a bucket neighbouring cuts could cross
+    tolerance = std::max(0.0, std::min(tolerance, 0.5));
+
+    // Bucket exchange: "flat" is a single Alltoallv, "node" aggregates per node through leaders
+    std::string exchange_mode = "flat";
+    const char* exchange_option = find_option(argc, argv, "exchange");
+    if (exchange_option != NULL) {
+        exchange_mode = exchange_option;
+    }
+    if (exchange_mode != "flat" && exchange_mode != "node") {
+        if (taskid == MASTER) {
+            std::cerr << "Unknown exchange '" << exchange_mode << "', expected 'flat' or 'node'\n";
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+    int node_size = 0;
+    const char* node_size_option = find_option(argc, argv, "node_size");
+    if (node_size_option != NULL) {
+        node_size = std::atoi(node_size_option);
+    }
+    adiak::value("splitters", splitter_mode);
+    adiak::value("imbalance_tolerance", tolerance);
+    adiak::value("exchange", exchange_mode);
+
     // Local data initialization
     CALI_MARK_BEGIN("data_init");
     std::vector<int> local_data;
@@ -151,40 +499,55 @@ int main(int argc, char* argv[]) {
     CALI_MARK_END("select_samples");
     CALI_MARK_END("comp");
 
-    // Gather all samples at master
+    // Gather all samples on every rank. Each rank's samples come out of its sorted local_data,
+    // so all_samples is numtasks sorted runs of numtasks samples each
     CALI_MARK_BEGIN("comm");
     CALI_MARK_BEGIN("gather_samples");
     std::vector<int> all_samples(numtasks * numtasks);
-    MPI_Gather(local_samples.data(), numtasks, MPI_INT, all_samples.data(), numtasks, MPI_INT, MASTER, MPI_COMM_WORLD);
+    MPI_Allgather(local_samples.data(), numtasks, MPI_INT, all_samples.data(), numtasks, MPI_INT, MPI_COMM_WORLD);
     CALI_MARK_END("gather_samples");
     CALI_MARK_END("comm");
 
-    // Splitters at master
+    // Every rank merges the sample runs and picks the same splitters, so nothing waits on the
+    // master to sort the samples and no broadcast is needed
     CALI_MARK_BEGIN("comp");
     CALI_MARK_BEGIN("choose_splitters");
-    std::vector<int> splitters;
-    if (taskid == MASTER) {
-        std::sort(all_samples.begin(), all_samples.end());
-        splitters = choose_splitters(all_samples, numtasks - 1);
+    std::vector<int> sample_bounds(numtasks + 1);
+    for (int i = 0; i <= numtasks; ++i) {
+        sample_bounds[i] = i * numtasks;
     }
+    merge_runs(all_samples, sample_bounds);
+    std::vector<int> splitters = choose_splitters(all_samples, numtasks - 1);
     CALI_MARK_END("choose_splitters");
     CALI_MARK_END("comp");
 
-    // Broadcast splitters
-    CALI_MARK_BEGIN("comm");
-    CALI_MARK_BEGIN("broadcast_splitters");
-    splitters.resize(numtasks - 1);
-    MPI_Bcast(splitters.data(), numtasks - 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-    CALI_MARK_END("broadcast_splitters");
-    CALI_MARK_END("comm");
+    // Balanced mode moves the bucket ends until the global bucket sizes are within tolerance
+    std::vector<int> balanced_ends;
+    if (splitter_mode == "balanced") {
+        CALI_MARK_BEGIN("comm");
+        CALI_MARK_BEGIN("refine_splitters");
+        balanced_ends = balance_splitters(local_data, splitters, tolerance);
+        CALI_MARK_END("refine_splitters");
+        CALI_MARK_END("comm");
+    }
 
-    // Partition local data based on splitters
+    // Partition local data based on splitters. local_data is sorted, so bucket i is the contiguous
+    // slice of keys in (splitters[i - 1], splitters[i]] and one binary search per splitter finds its end
     CALI_MARK_BEGIN("comp");
     CALI_MARK_BEGIN("partition_data");
-    std::vector<std::vector<int>> buckets(numtasks);
-    for (int i = 0; i < local_size; ++i) {
-        int bucket_idx = std::lower_bound(splitters.begin(), splitters.end(), local_data[i]) - splitters.begin();
-        buckets[bucket_idx].push_back(local_data[i]);
+    std::vector<int> send_sizes(numtasks);
+    std::vector<int> send_displs(numtasks);
+    int bucket_start = 0;
+    for (int i = 0; i < numtasks; ++i) {
+        int bucket_end = local_size;
+        if (i < numtasks - 1 && !balanced_ends.empty()) {
+            bucket_end = balanced_ends[i];
+        } else if (i < numtasks - 1) {
+            bucket_end = std::upper_bound(local_data.begin() + bucket_start, local_data.end(), splitters[i]) - local_data.begin();
+        }
+        send_displs[i] = bucket_start;
+        send_sizes[i] = bucket_end - bucket_start;
+        bucket_start = bucket_end;
     }
     CALI_MARK_END("partition_data");
     CALI_MARK_END("comp");
@@ -192,47 +555,64 @@ int main(int argc, char* argv[]) {
     // Send and receive bucket sizes
     CALI_MARK_BEGIN("comm");
     CALI_MARK_BEGIN("send_recv_sizes");
-    std::vector<int> send_sizes(numtasks);
     std::vector<int> recv_sizes(numtasks);
-    std::vector<int> send_displs(numtasks);
     std::vector<int> recv_displs(numtasks);
 
-    for (int i = 0; i < numtasks; ++i) {
-        send_sizes[i] = buckets[i].size();
-    }
-
     MPI_Alltoall(send_sizes.data(), 1, MPI_INT, recv_sizes.data(), 1, MPI_INT, MPI_COMM_WORLD);
 
-    send_displs[0] = recv_displs[0] = 0;
+    recv_displs[0] = 0;
     for (int i = 1; i < numtasks; ++i) {
-        send_displs[i] = send_displs[i - 1] + send_sizes[i - 1];
         recv_displs[i] = recv_displs[i - 1] + recv_sizes[i - 1];
     }
     CALI_MARK_END("send_recv_sizes");
     CALI_MARK_END("comm");
 
-    // Send and receive buckets
+    // Node communicators for the two-level exchange, timed apart from the exchange itself
+    NodeLayout layout;
+    if (exchange_mode == "node") {
+        CALI_MARK_BEGIN("comm");
+        CALI_MARK_BEGIN("node_setup");
+        layout = build_node_layout(node_size);
+        CALI_MARK_END("node_setup");
+        CALI_MARK_END("comm");
+    }
+
+    // Send and receive buckets, straight out of the sorted local_data
     CALI_MARK_BEGIN("comm");
     CALI_MARK_BEGIN("send_recv_buckets");
-    std::vector<int> send_data;
-    for (const auto& bucket : buckets) {
-        send_data.insert(send_data.end(), bucket.begin(), bucket.end());
-    }
-    
     std::vector<int> recv_data(recv_displs[numtasks - 1] + recv_sizes[numtasks - 1]);
 
-    MPI_Alltoallv(send_data.data(), send_sizes.data(), send_displs.data(), MPI_INT,
-                  recv_data.data(), recv_sizes.data(), recv_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    if (exchange_mode == "node") {
+        node_aware_exchange(layout, local_data, send_sizes, recv_sizes, recv_data);
+    } else {
+        MPI_Alltoallv(local_data.data(), send_sizes.data(), send_displs.data(), MPI_INT,
+                      recv_data.data(), recv_sizes.data(), recv_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    }
     CALI_MARK_END("send_recv_buckets");
     CALI_MARK_END("comm");
+    if (exchange_mode == "node") {
+        free_node_layout(layout);
+    }
 
-    // Final local sort
+    // Final local sort. recv_data holds one sorted run per sender, so merge them instead of sorting
     CALI_MARK_BEGIN("comp");
     CALI_MARK_BEGIN("final_local_sort");
-    std::sort(recv_data.begin(), recv_data.end());
+    std::vector<int> run_bounds(recv_displs);
+    run_bounds.push_back(recv_data.size());
+    merge_runs(recv_data, run_bounds);
     CALI_MARK_END("final_local_sort");
     CALI_MARK_END("comp");
 
+    // Report how far the largest bucket is from the even share N/P
+    long long bucket_size = recv_data.size(), largest_bucket = 0, total_keys = 0;
+    MPI_Allreduce(&bucket_size, &largest_bucket, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&bucket_size, &total_keys, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    double bucket_imbalance = largest_bucket * (double) numtasks / total_keys;
+    adiak::value("max_bucket_imbalance", bucket_imbalance);
+    if (taskid == MASTER) {
+        printf("Largest bucket holds %lld keys (%.3fx the even share)\n", largest_bucket, bucket_imbalance);
+    }
+
     // Correctness check
     correctness_check(recv_data);
 